@@ -0,0 +1,138 @@
+#ifndef UTHREADS_BOUNDEDQUEUE_H
+#define UTHREADS_BOUNDEDQUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+
+/**
+ * Bounded lock free multi producer single consumer FIFO queue
+ * Every cell has a sequence number that tells producers and the consumer whose turn
+ * it is to use it, so push only uses atomic operations and is safe to call from
+ * signal handlers and from any kernel thread
+ * T must be trivially copyable
+ */
+template <typename T>
+struct BoundedQueue {
+
+	/**
+	 * Bounded queue constructor
+	 * @param capacity the maximal number of items, a power of 2
+	 */
+	explicit BoundedQueue(size_t capacity) : mask(capacity - 1), cells(new Cell[capacity])
+	{
+		for (size_t i = 0; i < capacity; ++i)
+			cells[i].sequence.store(i, std::memory_order_relaxed);
+	}
+
+	/**
+	 * Bounded queue destructor
+	 */
+	~BoundedQueue() { delete[] cells; }
+
+	/**
+	 * Adds an item to the end of the queue
+	 * May be called by any kernel thread and from signal handlers
+	 * @param item the item to add
+	 * @return true if added, false if the queue is full
+	 */
+	bool push(T item)
+	{
+		size_t pos = tail.load(std::memory_order_relaxed);
+		Cell* cell;
+		for (;;)
+		{
+			cell = &cells[pos & mask];
+			intptr_t diff = (intptr_t)cell->sequence.load(std::memory_order_acquire) - (intptr_t)pos;
+			if (diff == 0)
+			{
+				if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					break;
+			}
+			else if (diff < 0)
+			{
+				return false;  // the cell still holds an item from the previous lap
+			}
+			else
+			{
+				pos = tail.load(std::memory_order_relaxed);
+			}
+		}
+
+		cell->item = item;
+		cell->sequence.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	/**
+	 * Removes the first item of the queue
+	 * Must only be called by the single consumer
+	 * @param item set to the removed item
+	 * @return true if an item was removed, false if the queue is empty
+	 */
+	bool pop(T* item)
+	{
+		size_t pos = head.load(std::memory_order_relaxed);
+		Cell* cell = &cells[pos & mask];
+		if (cell->sequence.load(std::memory_order_acquire) != pos + 1)
+			return false;
+
+		*item = cell->item;
+		cell->sequence.store(pos + mask + 1, std::memory_order_release);
+		head.store(pos + 1, std::memory_order_relaxed);
+		return true;
+	}
+
+	/**
+	 * Returns true if the queue seems empty
+	 * May be called by any kernel thread, also while the consumer pops. An item that
+	 * is being pushed or popped may not be visible yet
+	 */
+	bool empty() const
+	{
+		size_t pos = head.load(std::memory_order_relaxed);
+		return cells[pos & mask].sequence.load(std::memory_order_acquire) != pos + 1;
+	}
+
+private:
+
+	/**
+	 * A queue cell
+	 */
+	struct Cell {
+
+		/**
+		 * The position the cell can be pushed at, or the position + 1 once it holds an item
+		 */
+		std::atomic<size_t> sequence;
+
+		/**
+		 * The item
+		 */
+		T item;
+	};
+
+	/**
+	 * Capacity - 1, used to wrap positions
+	 */
+	size_t mask;
+
+	/**
+	 * The cells
+	 */
+	Cell* cells;
+
+	/**
+	 * The position of the next push
+	 */
+	std::atomic<size_t> tail{0};
+
+	/**
+	 * The position of the next pop, only changed by the consumer and read by empty()
+	 * on any kernel thread
+	 */
+	std::atomic<size_t> head{0};
+};
+
+#endif //UTHREADS_BOUNDEDQUEUE_H
@@ -0,0 +1,62 @@
+#ifndef UTHREADS_CHECK_H
+#define UTHREADS_CHECK_H
+
+#include <stdio.h>
+#include <unistd.h>
+#include "uthreads.h"
+
+/**
+ * Minimal assertions of the test programs, make check builds and runs them
+ * A failed check prints its condition and line and the test goes on. A test of
+ * the library ends with checkTerminate(), a test of an internal structure returns
+ * checkResult() from main
+ */
+
+/**
+ * The number of failed checks
+ */
+static int checkFailures = 0;
+
+/**
+ * Checks a condition, prints it with its line if it doesn't hold
+ */
+#define CHECK(cond) \
+	do { \
+		if (!(cond)) \
+		{ \
+			fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+			checkFailures++; \
+		} \
+	} while (0)
+
+/**
+ * Prints the result of a test program
+ * @param name the name of the test
+ * @return the exit status of the test program, 0 if all the checks passed
+ */
+static inline int checkResult(const char* name)
+{
+	if (checkFailures != 0)
+	{
+		fprintf(stderr, "%s: %d checks failed\n", name, checkFailures);
+		return 1;
+	}
+	printf("%s: passed\n", name);
+	return 0;
+}
+
+/**
+ * Ends a test program that initialized the library with the result of its checks
+ * Terminates the main thread if all the checks passed, so the library frees its
+ * memory and exits with 0, otherwise exits with 1 without touching the threads
+ * @param name the name of the test
+ */
+static inline void checkTerminate(const char* name)
+{
+	if (checkResult(name) != 0)
+		_exit(1);
+	fflush(stdout);
+	uthread_terminate(0);
+}
+
+#endif //UTHREADS_CHECK_H
@@ -0,0 +1,157 @@
+#include <stdint.h>
+#include "context.h"
+
+/**
+ * Default value of the SSE control and status register
+ */
+#define DEFAULT_MXCSR 0x1F80
+
+/**
+ * Default value of the x87 FPU control word
+ */
+#define DEFAULT_FPU_CW 0x037F
+
+/**
+ * Stack alignment required by the ABI at a call instruction
+ */
+#define STACK_ALIGN 16
+
+/**
+ * Entry point of a new context, defined in assembly below
+ * Calls entry(arg) with the entry and argument restored from the callee saved registers
+ */
+extern "C" void contextStart();
+
+
+#ifdef __x86_64__
+/* code for 64 bit Intel arch */
+
+/*
+ * Saved frame layout, from the saved stack pointer upwards:
+ * mxcsr | fpu cw, r15, r14, r13, r12, rbx, rbp, return address
+ */
+asm(".text\n"
+	".globl contextSwitch\n"
+	".type contextSwitch, @function\n"
+	"contextSwitch:\n"
+	"	pushq %rbp\n"
+	"	pushq %rbx\n"
+	"	pushq %r12\n"
+	"	pushq %r13\n"
+	"	pushq %r14\n"
+	"	pushq %r15\n"
+	"	subq $8, %rsp\n"
+	"	stmxcsr (%rsp)\n"
+	"	fnstcw 4(%rsp)\n"
+	"	movq %rsp, (%rdi)\n"
+	"	movq (%rsi), %rsp\n"
+	"	ldmxcsr (%rsp)\n"
+	"	fldcw 4(%rsp)\n"
+	"	addq $8, %rsp\n"
+	"	popq %r15\n"
+	"	popq %r14\n"
+	"	popq %r13\n"
+	"	popq %r12\n"
+	"	popq %rbx\n"
+	"	popq %rbp\n"
+	"	ret\n"
+	".size contextSwitch, .-contextSwitch\n"
+	".globl contextStart\n"
+	".type contextStart, @function\n"
+	"contextStart:\n"
+	"	movq %r13, %rdi\n"
+	"	callq *%r12\n"
+	"	ud2\n"
+	".size contextStart, .-contextStart\n");
+
+/**
+ * Prepares a context that starts executing entry(arg) on the given stack
+ * @param context the context to initialize
+ * @param stack the lowest address of the stack
+ * @param size the stack size in bytes
+ * @param entry the function the context starts with
+ * @param arg the argument passed to entry
+ */
+void contextInit(Context* context, char* stack, size_t size, void (*entry)(void*), void* arg)
+{
+	// the stack pointer must be aligned after contextSwitch returns into contextStart
+	uintptr_t top = ((uintptr_t)(stack + size)) & ~(uintptr_t)(STACK_ALIGN - 1);
+	uint64_t* frame = (uint64_t*)top - 8;
+
+	frame[0] = DEFAULT_MXCSR | ((uint64_t)DEFAULT_FPU_CW << 32);
+	frame[1] = 0;                       // r15
+	frame[2] = 0;                       // r14
+	frame[3] = (uint64_t)arg;           // r13
+	frame[4] = (uint64_t)entry;         // r12
+	frame[5] = 0;                       // rbx
+	frame[6] = 0;                       // rbp
+	frame[7] = (uint64_t)contextStart;  // return address
+
+	context->sp = frame;
+}
+
+#elif defined(__i386__)
+/* code for 32 bit Intel arch */
+
+/*
+ * Saved frame layout, from the saved stack pointer upwards:
+ * fpu cw, edi, esi, ebx, ebp, return address
+ */
+asm(".text\n"
+	".globl contextSwitch\n"
+	".type contextSwitch, @function\n"
+	"contextSwitch:\n"
+	"	movl 4(%esp), %eax\n"
+	"	movl 8(%esp), %ecx\n"
+	"	pushl %ebp\n"
+	"	pushl %ebx\n"
+	"	pushl %esi\n"
+	"	pushl %edi\n"
+	"	subl $4, %esp\n"
+	"	fnstcw (%esp)\n"
+	"	movl %esp, (%eax)\n"
+	"	movl (%ecx), %esp\n"
+	"	fldcw (%esp)\n"
+	"	addl $4, %esp\n"
+	"	popl %edi\n"
+	"	popl %esi\n"
+	"	popl %ebx\n"
+	"	popl %ebp\n"
+	"	ret\n"
+	".size contextSwitch, .-contextSwitch\n"
+	".globl contextStart\n"
+	".type contextStart, @function\n"
+	"contextStart:\n"
+	"	subl $12, %esp\n"
+	"	pushl %edi\n"
+	"	call *%esi\n"
+	"	ud2\n"
+	".size contextStart, .-contextStart\n");
+
+/**
+ * Prepares a context that starts executing entry(arg) on the given stack
+ * @param context the context to initialize
+ * @param stack the lowest address of the stack
+ * @param size the stack size in bytes
+ * @param entry the function the context starts with
+ * @param arg the argument passed to entry
+ */
+void contextInit(Context* context, char* stack, size_t size, void (*entry)(void*), void* arg)
+{
+	// the stack pointer must be aligned after contextSwitch returns into contextStart
+	uintptr_t top = ((uintptr_t)(stack + size)) & ~(uintptr_t)(STACK_ALIGN - 1);
+	uint32_t* frame = (uint32_t*)top - 6;
+
+	frame[0] = DEFAULT_FPU_CW;
+	frame[1] = (uint32_t)arg;           // edi
+	frame[2] = (uint32_t)entry;         // esi
+	frame[3] = 0;                       // ebx
+	frame[4] = 0;                       // ebp
+	frame[5] = (uint32_t)contextStart;  // return address
+
+	context->sp = frame;
+}
+
+#else
+#error "unsupported architecture, only x86-64 and i386 are supported"
+#endif
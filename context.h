@@ -0,0 +1,41 @@
+#ifndef UTHREADS_CONTEXT_H
+#define UTHREADS_CONTEXT_H
+
+#include <stddef.h>
+
+
+/**
+ * Saved execution context of a thread
+ * Only the stack pointer is kept in the context, the callee saved registers
+ * are pushed on the thread stack by contextSwitch
+ */
+struct Context {
+
+	/**
+	 * The saved stack pointer
+	 */
+	void* sp = nullptr;
+};
+
+/**
+ * Saves the callee saved registers and stack pointer of the caller in from
+ * and resumes the execution saved in to
+ * Returns when another contextSwitch resumes from
+ * @param from the context to save the current execution in
+ * @param to the context to resume
+ */
+extern "C" void contextSwitch(Context* from, Context* to);
+
+/**
+ * Prepares a context that starts executing entry(arg) on the given stack
+ * the first time it is resumed by contextSwitch
+ * The entry function must not return
+ * @param context the context to initialize
+ * @param stack the lowest address of the stack
+ * @param size the stack size in bytes
+ * @param entry the function the context starts with
+ * @param arg the argument passed to entry
+ */
+void contextInit(Context* context, char* stack, size_t size, void (*entry)(void*), void* arg);
+
+#endif //UTHREADS_CONTEXT_H
@@ -0,0 +1,135 @@
+#include <limits.h>
+#include "idallocator.h"
+
+/**
+ * Number of bits in a bitmap word
+ */
+#define WORD_BITS 64
+
+/**
+ * Returns a word with only the bit of the given index set
+ */
+#define BIT(index) ((uint64_t)1 << ((index) % WORD_BITS))
+
+
+//---------------------------------------- Public Methods -------------------------------------------------
+
+
+/**
+ * Allocates the lowest free id
+ * @return the allocated id, -1 if all the ids up to the limit are allocated
+ */
+int IdAllocator::allocate()
+{
+	// all the ids are allocated, grow the bitmap
+	if (levels.empty() || levels.back()[0] == 0)
+	{
+		if (limit != 0 && size >= limit)
+			return -1;
+
+		int capacity = size == 0 ? WORD_BITS : (size > INT_MAX / 2 ? INT_MAX : size * 2);
+		if (limit != 0 && capacity > limit)
+			capacity = limit;
+		resize(capacity);
+	}
+
+	// descend from the top level to the lowest free id
+	size_t index = 0;
+	for (size_t l = levels.size(); l-- > 0;)
+		index = index * WORD_BITS + __builtin_ctzll(levels[l][index]);
+	int id = (int)index;
+
+	// mark the id allocated, and clear the bits of words that have no free id left
+	for (size_t l = 0; l < levels.size(); ++l)
+	{
+		uint64_t& word = levels[l][index / WORD_BITS];
+		word &= ~BIT(index);
+		if (word != 0)
+			break;
+		index /= WORD_BITS;
+	}
+
+	return id;
+}
+
+/**
+ * Frees an allocated id
+ * @param id the id to free
+ */
+void IdAllocator::release(int id)
+{
+	// mark the id free, and set the bits of words that had no free id
+	size_t index = (size_t)id;
+	for (size_t l = 0; l < levels.size(); ++l)
+	{
+		uint64_t& word = levels[l][index / WORD_BITS];
+		bool full = word == 0;
+		word |= BIT(index);
+		if (!full)
+			break;
+		index /= WORD_BITS;
+	}
+}
+
+/**
+ * Sets the maximal number of ids that can be allocated
+ * @param limit the maximal number of ids, 0 for no limit
+ */
+void IdAllocator::setLimit(int limit)
+{
+	this->limit = limit;
+}
+
+/**
+ * Grows the bitmap to hold at least the given number of ids
+ * @param capacity the number of ids
+ */
+void IdAllocator::reserve(int capacity)
+{
+	if (limit != 0 && capacity > limit)
+		capacity = limit;
+	if (capacity > size)
+		resize(capacity);
+}
+
+/**
+ * Returns the number of ids the bitmap holds
+ */
+int IdAllocator::capacity() const
+{
+	return size;
+}
+
+
+//------------------------------------- Private Methods --------------------------------------------
+
+
+/**
+ * Rebuilds the bitmap to hold the given number of ids, keeping the allocated ids
+ * @param capacity the number of ids
+ */
+void IdAllocator::resize(int capacity)
+{
+	std::vector<uint64_t> free((capacity + WORD_BITS - 1) / WORD_BITS, 0);
+
+	// keep the allocated ids, the new ids are free
+	if (!levels.empty())
+		for (size_t i = 0; i < levels[0].size(); ++i)
+			free[i] = levels[0][i];
+	for (int id = size; id < capacity; ++id)
+		free[id / WORD_BITS] |= BIT(id);
+
+	// rebuild the summary levels up to a single word
+	levels.clear();
+	levels.push_back(free);
+	while (levels.back().size() > 1)
+	{
+		std::vector<uint64_t> level((levels.back().size() + WORD_BITS - 1) / WORD_BITS, 0);
+		for (size_t i = 0; i < levels.back().size(); ++i)
+			if (levels.back()[i] != 0)
+				level[i / WORD_BITS] |= BIT(i);
+		levels.push_back(level);
+	}
+
+	size = capacity;
+}
@@ -0,0 +1,72 @@
+#ifndef UTHREADS_IDALLOCATOR_H
+#define UTHREADS_IDALLOCATOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+
+/**
+ * Allocates the lowest free id in O(1)
+ * Free ids are kept in a hierarchical bitmap, each bit in a level tells whether
+ * the matching word in the level below has a free id, so finding the lowest free
+ * id takes one find-first-set per level.
+ * The bitmap grows on demand up to the id limit
+ */
+struct IdAllocator {
+
+	/**
+	 * Allocates the lowest free id
+	 * @return the allocated id, -1 if all the ids up to the limit are allocated
+	 */
+	int allocate();
+
+	/**
+	 * Frees an allocated id
+	 * @param id the id to free
+	 */
+	void release(int id);
+
+	/**
+	 * Sets the maximal number of ids that can be allocated
+	 * @param limit the maximal number of ids, 0 for no limit
+	 */
+	void setLimit(int limit);
+
+	/**
+	 * Grows the bitmap to hold at least the given number of ids
+	 * @param capacity the number of ids
+	 */
+	void reserve(int capacity);
+
+	/**
+	 * Returns the number of ids the bitmap holds
+	 */
+	int capacity() const;
+
+private:
+
+	/**
+	 * The bitmap levels, levels[0] has a set bit for every free id
+	 * The last level is a single word
+	 */
+	std::vector<std::vector<uint64_t>> levels;
+
+	/**
+	 * The number of ids the bitmap holds
+	 */
+	int size = 0;
+
+	/**
+	 * The maximal number of ids
+	 */
+	int limit = 0;
+
+	/**
+	 * Rebuilds the bitmap to hold the given number of ids, keeping the allocated ids
+	 * @param capacity the number of ids
+	 */
+	void resize(int capacity);
+};
+
+#endif //UTHREADS_IDALLOCATOR_H
@@ -0,0 +1,269 @@
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "ioring.h"
+
+/**
+ * The kernel features the ring needs: completions are never dropped, a file offset
+ * of -1 reads and writes at the file position, and a non-blocking file descriptor
+ * that isn't ready is polled by the kernel instead of failing with EAGAIN
+ */
+#define IO_RING_FEATURES (IORING_FEAT_NODROP | IORING_FEAT_RW_CUR_POS | IORING_FEAT_FAST_POLL)
+
+
+/**
+ * io_uring_enter(2), retried when interrupted by a signal
+ * @return the number of submitted entries, -1 on failure
+ */
+static int enter(int fd, unsigned toSubmit, unsigned flags)
+{
+	int ret;
+	do {
+		ret = (int)syscall(__NR_io_uring_enter, fd, toSubmit, 0, flags, nullptr, 0);
+	} while (ret == -1 && errno == EINTR);
+	return ret;
+}
+
+/**
+ * Returns the address at the given offset of a mapped ring
+ */
+template <typename T>
+static T* at(void* ring, unsigned offset)
+{
+	return reinterpret_cast<T*>(static_cast<char*>(ring) + offset);
+}
+
+
+/**
+ * IoRing destructor
+ */
+IoRing::~IoRing()
+{
+	close();
+}
+
+/**
+ * Sets up the ring
+ * @param entries the number of submission queue entries, a power of 2
+ * @return true if successful, false if the kernel doesn't support io_uring or
+ * lacks a needed feature
+ */
+bool IoRing::open(unsigned entries)
+{
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	ringFd = (int)syscall(__NR_io_uring_setup, entries, &params);
+	if (ringFd == -1)
+		return false;
+	if ((params.features & IO_RING_FEATURES) != IO_RING_FEATURES)
+	{
+		close();
+		return false;
+	}
+
+	sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+
+	// newer kernels map both rings together
+	bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+	if (single && cqRingSize > sqRingSize)
+		sqRingSize = cqRingSize;
+
+	sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd,
+				  IORING_OFF_SQ_RING);
+	if (sqRing == MAP_FAILED)
+	{
+		sqRing = nullptr;
+		close();
+		return false;
+	}
+	cqRing = single ? sqRing : mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+									ringFd, IORING_OFF_CQ_RING);
+	if (cqRing == MAP_FAILED)
+	{
+		cqRing = nullptr;
+		close();
+		return false;
+	}
+	void* mapped = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd,
+						IORING_OFF_SQES);
+	if (mapped == MAP_FAILED)
+	{
+		close();
+		return false;
+	}
+	sqes = static_cast<struct io_uring_sqe*>(mapped);
+
+	sqHead = at<unsigned>(sqRing, params.sq_off.head);
+	sqTail = at<unsigned>(sqRing, params.sq_off.tail);
+	sqFlags = at<unsigned>(sqRing, params.sq_off.flags);
+	sqEntries = params.sq_entries;
+	sqMask = *at<unsigned>(sqRing, params.sq_off.ring_mask);
+	cqHead = at<unsigned>(cqRing, params.cq_off.head);
+	cqTail = at<unsigned>(cqRing, params.cq_off.tail);
+	cqMask = *at<unsigned>(cqRing, params.cq_off.ring_mask);
+	cqes = at<struct io_uring_cqe>(cqRing, params.cq_off.cqes);
+
+	// entries are used in ring order, so the index array maps every slot to itself
+	unsigned* array = at<unsigned>(sqRing, params.sq_off.array);
+	for (unsigned i = 0; i < sqEntries; ++i)
+		array[i] = i;
+
+	return true;
+}
+
+/**
+ * Returns the number of queued entries that weren't submitted yet
+ */
+unsigned IoRing::pending() const
+{
+	return *sqTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * Queues an operation of a thread, it is submitted by the next call to submit
+ * @param thread the thread, must not have an operation in flight
+ * @param opcode the IORING_OP_ operation
+ * @param fd the file descriptor
+ * @param addr the buffer, or the operation specific address
+ * @param len the buffer length
+ * @param offset the file offset, or the operation specific value
+ * @param flags the operation specific flags
+ * @return true if queued, false if the submission queue is full
+ */
+bool IoRing::prepare(Thread* thread, int opcode, int fd, const void* addr, unsigned len,
+					 unsigned long long offset, unsigned flags)
+{
+	struct io_uring_sqe* sqe = nextEntry();
+	if (sqe == nullptr)
+		return false;
+
+	sqe->opcode = (__u8)opcode;
+	sqe->fd = fd;
+	sqe->addr = (__u64)(uintptr_t)addr;
+	sqe->len = len;
+	sqe->off = offset;
+	sqe->rw_flags = (__kernel_rwf_t)flags;  // shares its place with the flags of every operation
+	sqe->user_data = (__u64)(uintptr_t)thread;
+	push();
+
+	thread->ioPending = true;
+	nInFlight++;
+	return true;
+}
+
+/**
+ * Queues the cancellation of the operation of a thread
+ * The operation still completes, with -ECANCELED unless it was done already
+ * If the ring stays full the operation isn't cancelled, and completes on its own
+ * @param thread the thread, must have an operation in flight
+ */
+void IoRing::cancel(Thread* thread)
+{
+	struct io_uring_sqe* sqe = nextEntry();
+	if (sqe == nullptr)
+		return;
+
+	// the completion of the cancellation has no thread, it is skipped when reaped
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->addr = (__u64)(uintptr_t)thread;
+	sqe->user_data = 0;
+	push();
+}
+
+/**
+ * Submits the queued entries with a single system call
+ * Entries the kernel can't take now stay queued for the next call
+ */
+void IoRing::submit()
+{
+	unsigned n = pending();
+	if (n != 0)
+		enter(ringFd, n, 0);
+}
+
+/**
+ * Reaps the next completion of a thread operation, the thread gets its result
+ * @return the thread whose operation completed, nullptr if there are no more completions
+ */
+Thread* IoRing::complete()
+{
+	for (;;)
+	{
+		unsigned head = *cqHead;
+		if (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE))
+		{
+			// completions that didn't fit in the ring are kept by the kernel until asked for
+			if ((__atomic_load_n(sqFlags, __ATOMIC_RELAXED) & IORING_SQ_CQ_OVERFLOW) == 0 ||
+				enter(ringFd, 0, IORING_ENTER_GETEVENTS) == -1 ||
+				head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE))
+				return nullptr;
+		}
+
+		struct io_uring_cqe* cqe = &cqes[head & cqMask];
+		Thread* thread = reinterpret_cast<Thread*>((uintptr_t)cqe->user_data);
+		int result = cqe->res;
+		__atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+
+		if (thread != nullptr)
+		{
+			thread->ioPending = false;
+			thread->ioResult = result;
+			nInFlight--;
+			return thread;
+		}
+	}
+}
+
+/**
+ * Returns a cleared submission entry at the tail of the ring, submitting the queued
+ * entries first if the ring is full
+ * @return the entry, nullptr if the ring is still full
+ */
+struct io_uring_sqe* IoRing::nextEntry()
+{
+	if (pending() >= sqEntries)
+	{
+		submit();
+		if (pending() >= sqEntries)
+			return nullptr;
+	}
+
+	struct io_uring_sqe* sqe = &sqes[*sqTail & sqMask];
+	memset(sqe, 0, sizeof(*sqe));
+	return sqe;
+}
+
+/**
+ * Queues the entry returned by nextEntry
+ */
+void IoRing::push()
+{
+	// the kernel reads the entry once it sees the new tail
+	__atomic_store_n(sqTail, *sqTail + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Unmaps the rings and closes the ring file descriptor
+ */
+void IoRing::close()
+{
+	if (sqes != nullptr)
+		munmap(sqes, sqesSize);
+	if (cqRing != nullptr && cqRing != sqRing)
+		munmap(cqRing, cqRingSize);
+	if (sqRing != nullptr)
+		munmap(sqRing, sqRingSize);
+	if (ringFd != -1)
+		::close(ringFd);
+
+	sqes = nullptr;
+	cqRing = nullptr;
+	sqRing = nullptr;
+	ringFd = -1;
+}
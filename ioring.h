@@ -0,0 +1,202 @@
+#ifndef UTHREADS_IORING_H
+#define UTHREADS_IORING_H
+
+#include <stddef.h>
+#include <linux/io_uring.h>
+#include "thread.h"
+
+/**
+ * Number of submission queue entries of the ring, a power of 2
+ */
+#define IO_RING_ENTRIES 256
+
+
+/**
+ * io_uring submission and completion rings, set up with raw system calls
+ * A thread queues its operation as a submission entry and waits, the scheduler submits
+ * the entries queued by all the threads with a single system call and wakes up the
+ * threads as their completions are reaped from the shared completion ring, which takes
+ * no system call at all.
+ * The ring file descriptor is readable while completions wait to be reaped, so the
+ * idle scheduler waits for them in the poller.
+ * A thread has at most one operation in flight, the thread is the user data of its entry
+ */
+struct IoRing {
+
+	/**
+	 * IoRing destructor
+	 */
+	~IoRing();
+
+	/**
+	 * Sets up the ring
+	 * @param entries the number of submission queue entries, a power of 2
+	 * @return true if successful, false if the kernel doesn't support io_uring or
+	 * lacks a needed feature
+	 */
+	bool open(unsigned entries);
+
+	/**
+	 * Returns true if the ring is set up
+	 */
+	bool active() const
+	{
+		return ringFd != -1;
+	}
+
+	/**
+	 * Returns the ring file descriptor
+	 */
+	int fd() const
+	{
+		return ringFd;
+	}
+
+	/**
+	 * Returns true if threads wait for the completion of their operations
+	 */
+	bool busy() const
+	{
+		return nInFlight > 0;
+	}
+
+	/**
+	 * Returns the number of queued entries that weren't submitted yet
+	 */
+	unsigned pending() const;
+
+	/**
+	 * Queues an operation of a thread, it is submitted by the next call to submit
+	 * @param thread the thread, must not have an operation in flight
+	 * @param opcode the IORING_OP_ operation
+	 * @param fd the file descriptor
+	 * @param addr the buffer, or the operation specific address
+	 * @param len the buffer length
+	 * @param offset the file offset, or the operation specific value
+	 * @param flags the operation specific flags
+	 * @return true if queued, false if the submission queue is full
+	 */
+	bool prepare(Thread* thread, int opcode, int fd, const void* addr, unsigned len,
+				 unsigned long long offset, unsigned flags);
+
+	/**
+	 * Queues the cancellation of the operation of a thread
+	 * The operation still completes, with -ECANCELED unless it was done already
+	 * @param thread the thread, must have an operation in flight
+	 */
+	void cancel(Thread* thread);
+
+	/**
+	 * Submits the queued entries with a single system call
+	 * Entries the kernel can't take now stay queued for the next call
+	 */
+	void submit();
+
+	/**
+	 * Reaps the next completion of a thread operation, the thread gets its result
+	 * @return the thread whose operation completed, nullptr if there are no more completions
+	 */
+	Thread* complete();
+
+private:
+
+	/**
+	 * The ring file descriptor, -1 if the ring isn't set up
+	 */
+	int ringFd = -1;
+
+	/**
+	 * The mapped submission ring
+	 */
+	void* sqRing = nullptr;
+
+	/**
+	 * The size of the mapped submission ring
+	 */
+	size_t sqRingSize = 0;
+
+	/**
+	 * The mapped completion ring, the submission ring if the kernel maps both together
+	 */
+	void* cqRing = nullptr;
+
+	/**
+	 * The size of the mapped completion ring
+	 */
+	size_t cqRingSize = 0;
+
+	/**
+	 * The mapped submission entries
+	 */
+	struct io_uring_sqe* sqes = nullptr;
+
+	/**
+	 * The size of the mapped submission entries
+	 */
+	size_t sqesSize = 0;
+
+	/**
+	 * The submission ring head, advanced by the kernel
+	 */
+	unsigned* sqHead = nullptr;
+
+	/**
+	 * The submission ring tail, advanced when an entry is queued
+	 */
+	unsigned* sqTail = nullptr;
+
+	/**
+	 * The submission ring flags, the kernel sets IORING_SQ_CQ_OVERFLOW in them
+	 */
+	unsigned* sqFlags = nullptr;
+
+	/**
+	 * The number of submission entries and the mask of an index into them
+	 */
+	unsigned sqEntries = 0;
+	unsigned sqMask = 0;
+
+	/**
+	 * The completion ring head, advanced when a completion is reaped
+	 */
+	unsigned* cqHead = nullptr;
+
+	/**
+	 * The completion ring tail, advanced by the kernel
+	 */
+	unsigned* cqTail = nullptr;
+
+	/**
+	 * The mask of an index into the completions
+	 */
+	unsigned cqMask = 0;
+
+	/**
+	 * The completions
+	 */
+	struct io_uring_cqe* cqes = nullptr;
+
+	/**
+	 * The number of thread operations that didn't complete yet
+	 */
+	int nInFlight = 0;
+
+	/**
+	 * Returns a cleared submission entry at the tail of the ring, submitting the queued
+	 * entries first if the ring is full
+	 * @return the entry, nullptr if the ring is still full
+	 */
+	struct io_uring_sqe* nextEntry();
+
+	/**
+	 * Queues the entry returned by nextEntry
+	 */
+	void push();
+
+	/**
+	 * Unmaps the rings and closes the ring file descriptor
+	 */
+	void close();
+};
+
+#endif //UTHREADS_IORING_H
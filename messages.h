@@ -17,6 +17,11 @@
  */
 #define SYS_ERR_MEM_ALLOC "failed memory allocation.\n"
 
+/**
+ * Thread stack allocation error message
+ */
+#define SYS_ERR_STACK_ALLOC "failed to allocate a thread stack.\n"
+
 /**
  * sigaction failure error message
  */
@@ -27,6 +32,21 @@
  */
 #define SYS_ERR_TIMER "failed to set the value of the interval timer.\n"
 
+/**
+ * Worker kernel thread creation failure error message
+ */
+#define SYS_ERR_WORKER "failed to create a worker thread.\n"
+
+/**
+ * Offload pool thread creation failure error message
+ */
+#define SYS_ERR_OFFLOAD "failed to create an offload thread.\n"
+
+/**
+ * Idle poller creation failure error message
+ */
+#define SYS_ERR_POLLER "failed to create the idle poller.\n"
+
 /**
  * Failure to initialize signal set error message
  */
@@ -37,6 +57,21 @@
  */
 #define LIB_ERR_QUANTUM "invalid quantum size.\n"
 
+/**
+ * Invalid library options error message
+ */
+#define LIB_ERR_OPTIONS "invalid library options.\n"
+
+/**
+ * Invalid stack size error message
+ */
+#define LIB_ERR_STACK_SIZE "invalid stack size.\n"
+
+/**
+ * Failure to map a thread stack of the requested size error message
+ */
+#define LIB_ERR_STACK_ALLOC "failed to map the thread stack.\n"
+
 /**
  * Max number of threads exceeded error message
  */
@@ -57,9 +92,79 @@
  */
 #define LIB_ERR_RESUME "failed to resume requested thread.\n"
 
+/**
+ * Failure to yield to a thread error message
+ */
+#define LIB_ERR_YIELD_TO "failed to yield to requested thread.\n"
+
+/**
+ * Failure to set the priority of a thread error message
+ */
+#define LIB_ERR_PRIORITY "failed to set the priority of requested thread.\n"
+
+/**
+ * Failure to set the quantum of a thread error message
+ */
+#define LIB_ERR_SET_QUANTUM "failed to set the quantum of requested thread.\n"
+
+/**
+ * Failure to sleep error message
+ */
+#define LIB_ERR_SLEEP "failed to sleep, the time must not be negative.\n"
+
+/**
+ * Failure to wait for a file descriptor error message
+ */
+#define LIB_ERR_WAIT_FD "failed to wait for the file descriptor.\n"
+
+/**
+ * Failure to wait on an address error message
+ */
+#define LIB_ERR_WAIT "failed to wait on the address, it must not be null.\n"
+
+/**
+ * Failure to wake the threads waiting on an address error message
+ */
+#define LIB_ERR_WAKE "failed to wake the threads waiting on the address, invalid address or count.\n"
+
+/**
+ * Failure to offload a call error message
+ */
+#define LIB_ERR_OFFLOAD "failed to offload the call, the function must not be null.\n"
+
+/**
+ * Failure to unlock a mutex error message
+ */
+#define LIB_ERR_MUTEX "failed to unlock the mutex, it isn't locked.\n"
+
+/**
+ * Failure to initialize a semaphore error message
+ */
+#define LIB_ERR_SEM "failed to initialize the semaphore, the value must not be negative.\n"
+
+/**
+ * Failure to create a channel error message
+ */
+#define LIB_ERR_CHAN_INIT "failed to create the channel, invalid element size or capacity.\n"
+
+/**
+ * Failure to allocate the buffer of a channel error message
+ */
+#define LIB_ERR_CHAN_ALLOC "failed to create the channel, the buffer can't be allocated.\n"
+
+/**
+ * Failure to destroy a channel error message
+ */
+#define LIB_ERR_CHAN_DESTROY "failed to destroy the channel, threads wait on it.\n"
+
 /**
  * Failure to sync thread error message
  */
 #define LIB_ERR_SYNC "failed to sync requested thread.\n"
 
+/**
+ * Failure to join thread error message
+ */
+#define LIB_ERR_JOIN "failed to join requested thread.\n"
+
 #endif //UTHREADS_MESSAGES_H
@@ -0,0 +1,141 @@
+#include <iostream>
+#include <errno.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdlib.h> // for exit()
+#include "offload.h"
+#include "messages.h"
+
+
+/**
+ * Sets the pool size and the function that tells the scheduler a call finished
+ * @param max the maximal number of pool threads
+ * @param notify called by a pool thread after it pushed a finished call, may be
+ * called by any kernel thread
+ */
+void OffloadPool::configure(int max, void (*notify)())
+{
+	this->max = max;
+	this->notify = notify;
+}
+
+/**
+ * Queues the call of a thread, offloadFn and offloadArg are set
+ * Terminates the process if no pool thread can be started
+ * @param thread the thread
+ */
+void OffloadPool::submit(Thread* thread)
+{
+	pthread_mutex_lock(&lock);
+	try {
+		calls.push_back(thread);
+	} catch (std::bad_alloc& e) {
+		std::cerr << SYS_ERR_HEADER << SYS_ERR_MEM_ALLOC;
+		exit(1);
+	}
+
+	// start another pool thread if every started one is busy
+	if (nIdle > 0)
+		pthread_cond_signal(&queued);
+	if (nIdle < (int)calls.size() && nThreads < max && startThread())
+		nThreads++;
+
+	bool stuck = nThreads == 0;
+	pthread_mutex_unlock(&lock);
+
+	if (stuck)
+	{
+		std::cerr << SYS_ERR_HEADER << SYS_ERR_OFFLOAD;
+		exit(1);
+	}
+}
+
+/**
+ * Removes the call of a thread that didn't start running yet
+ * @param thread the thread
+ * @return true if removed, false if the call is running or finished
+ */
+bool OffloadPool::cancel(Thread* thread)
+{
+	bool removed = false;
+	pthread_mutex_lock(&lock);
+	for (std::deque<Thread*>::iterator it = calls.begin(); it != calls.end(); ++it)
+	{
+		if (*it == thread)
+		{
+			calls.erase(it);
+			removed = true;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&lock);
+	return removed;
+}
+
+/**
+ * @return true if a pool thread was started, it may still run a call
+ */
+bool OffloadPool::started()
+{
+	pthread_mutex_lock(&lock);
+	bool any = nThreads != 0;
+	pthread_mutex_unlock(&lock);
+	return any;
+}
+
+/**
+ * Starts a pool thread with all the signals blocked
+ * The quantum signal is handled by the workers, and the calls run outside any thread
+ * @return true if started, otherwise false
+ */
+bool OffloadPool::startThread()
+{
+	// the new kernel thread inherits the signal mask
+	sigset_t all, saved;
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &saved);
+
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	pthread_t pthread;
+	int ret = pthread_create(&pthread, &attr, run, this);
+	pthread_attr_destroy(&attr);
+
+	pthread_sigmask(SIG_SETMASK, &saved, nullptr);
+	return ret == 0;
+}
+
+/**
+ * Loop of a pool thread, runs the queued calls
+ * @param arg the pool
+ * @return never returns
+ */
+void* OffloadPool::run(void* arg)
+{
+	OffloadPool* pool = static_cast<OffloadPool*>(arg);
+
+	for (;;)
+	{
+		pthread_mutex_lock(&pool->lock);
+		while (pool->calls.empty())
+		{
+			pool->nIdle++;
+			pthread_cond_wait(&pool->queued, &pool->lock);
+			pool->nIdle--;
+		}
+		Thread* thread = pool->calls.front();
+		pool->calls.pop_front();
+		pthread_mutex_unlock(&pool->lock);
+
+		errno = 0;
+		thread->offloadResult = thread->offloadFn(thread->offloadArg);
+		thread->offloadErrno = errno;
+
+		// the scheduler drains the queue at every thread switch, a full queue empties quickly
+		while (!pool->finished.push(thread))
+			sched_yield();
+		pool->notify();
+	}
+	return nullptr;
+}
@@ -0,0 +1,114 @@
+#ifndef UTHREADS_OFFLOAD_H
+#define UTHREADS_OFFLOAD_H
+
+#include <pthread.h>
+#include <deque>
+#include "boundedqueue.h"
+#include "thread.h"
+
+/**
+ * Default maximal number of kernel threads running offloaded calls
+ */
+#define OFFLOAD_DEFAULT_THREADS 4
+
+/**
+ * Maximal number of finished offloaded calls waiting for the scheduler, a power of 2
+ */
+#define OFFLOAD_CAPACITY 256
+
+
+/**
+ * Pool of kernel threads that run the blocking calls of threads
+ * A thread queues its call and waits, a pool thread runs the call and pushes the thread
+ * to a lock free queue of finished calls that the scheduler drains, so the other threads
+ * keep running while the call blocks.
+ * Pool threads are started on demand, while every started pool thread is busy, up to
+ * the maximal number of pool threads. They block all signals
+ */
+struct OffloadPool {
+
+	/**
+	 * The threads whose calls finished, drained by the scheduler
+	 */
+	BoundedQueue<Thread*> finished{OFFLOAD_CAPACITY};
+
+	/**
+	 * Sets the pool size and the function that tells the scheduler a call finished
+	 * @param max the maximal number of pool threads
+	 * @param notify called by a pool thread after it pushed a finished call, may be
+	 * called by any kernel thread
+	 */
+	void configure(int max, void (*notify)());
+
+	/**
+	 * Queues the call of a thread, offloadFn and offloadArg are set
+	 * Terminates the process if no pool thread can be started
+	 * @param thread the thread
+	 */
+	void submit(Thread* thread);
+
+	/**
+	 * Removes the call of a thread that didn't start running yet
+	 * @param thread the thread
+	 * @return true if removed, false if the call is running or finished
+	 */
+	bool cancel(Thread* thread);
+
+	/**
+	 * @return true if a pool thread was started, it may still run a call
+	 */
+	bool started();
+
+private:
+
+	/**
+	 * Guards the queued calls and the pool thread counters
+	 * Never destroyed, pool threads may wait on it until the process exits
+	 */
+	pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+	/**
+	 * Signaled when a call is queued
+	 */
+	pthread_cond_t queued = PTHREAD_COND_INITIALIZER;
+
+	/**
+	 * The threads whose calls wait for a pool thread
+	 */
+	std::deque<Thread*> calls;
+
+	/**
+	 * The number of started pool threads
+	 */
+	int nThreads = 0;
+
+	/**
+	 * The number of pool threads waiting for a call
+	 */
+	int nIdle = 0;
+
+	/**
+	 * The maximal number of pool threads
+	 */
+	int max = OFFLOAD_DEFAULT_THREADS;
+
+	/**
+	 * Tells the scheduler a call finished
+	 */
+	void (*notify)() = nullptr;
+
+	/**
+	 * Starts a pool thread with all the signals blocked
+	 * @return true if started, otherwise false
+	 */
+	bool startThread();
+
+	/**
+	 * Loop of a pool thread, runs the queued calls
+	 * @param arg the pool
+	 * @return never returns
+	 */
+	static void* run(void* arg);
+};
+
+#endif //UTHREADS_OFFLOAD_H
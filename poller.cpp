@@ -0,0 +1,244 @@
+#include <iostream>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h> // for exit()
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "poller.h"
+#include "messages.h"
+
+
+/**
+ * Returns the epoll events of UTHREAD_FD_ events, they are also poll(2) events
+ */
+uint32_t toEpoll(int events)
+{
+	return ((events & UTHREAD_FD_READ) ? (uint32_t)(EPOLLIN | EPOLLRDHUP) : 0) |
+		   ((events & UTHREAD_FD_WRITE) ? (uint32_t)EPOLLOUT : 0);
+}
+
+/**
+ * Returns the UTHREAD_FD_ events of epoll or poll(2) events
+ * An error or a hang up wakes up the readers and the writers, their next call fails or returns 0
+ */
+int fromEpoll(uint32_t events)
+{
+	int ready = 0;
+	if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+		ready |= UTHREAD_FD_READ;
+	if (events & (EPOLLOUT | EPOLLHUP | EPOLLERR))
+		ready |= UTHREAD_FD_WRITE;
+	return ready;
+}
+
+/**
+ * Returns the events the waiters of a file descriptor wait for
+ */
+static int waitedEvents(const FdWatch* watch)
+{
+	int events = 0;
+	for (Thread* thread = watch->waiters.front(); thread != nullptr; thread = thread->next)
+		events |= thread->fdEvents;
+	return events;
+}
+
+
+/**
+ * Poller destructor
+ */
+Poller::~Poller()
+{
+	for (size_t i = 0; i < fds.size(); ++i)
+		delete fds[i];
+}
+
+/**
+ * Creates the epoll instance and the wake up eventfd
+ * Terminates the process if they can't be created
+ */
+void Poller::open()
+{
+	epollFd = epoll_create1(EPOLL_CLOEXEC);
+	wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+	struct epoll_event event;
+	event.events = EPOLLIN;
+	event.data.fd = wakeFd;
+	if (epollFd == -1 || wakeFd == -1 || epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event) == -1)
+	{
+		std::cerr << SYS_ERR_HEADER << SYS_ERR_POLLER;
+		exit(1);
+	}
+}
+
+/**
+ * Adds a file descriptor whose readiness ends the wait, like a wake up
+ * Its events aren't dispatched, the owner of the file descriptor handles them
+ * Terminates the process if it can't be added
+ * @param fd the file descriptor, polled for reading
+ */
+void Poller::attach(int fd)
+{
+	// level triggered, the wait returns until the owner handled the events
+	struct epoll_event event;
+	event.events = EPOLLIN;
+	event.data.fd = fd;
+	if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) == -1)
+	{
+		std::cerr << SYS_ERR_HEADER << SYS_ERR_POLLER;
+		exit(1);
+	}
+	attachedFd = fd;
+}
+
+/**
+ * Adds a thread to the waiters of a file descriptor
+ * @param thread the thread, not in any queue
+ * @param fd the file descriptor
+ * @param events the events to wait for, UTHREAD_FD_ values
+ * @return true if successful, false if the file descriptor can't be polled (errno is set)
+ */
+bool Poller::watch(Thread* thread, int fd, int events)
+{
+	FdWatch* watch;
+	try {
+		if ((size_t)fd >= fds.size())
+			fds.resize(fd + 1, nullptr);
+		if (fds[fd] == nullptr)
+			fds[fd] = new FdWatch;
+		watch = fds[fd];
+	} catch (std::bad_alloc& e) {
+		std::cerr << SYS_ERR_HEADER << SYS_ERR_MEM_ALLOC;
+		exit(1);
+	}
+
+	if (!arm(fd, watch, waitedEvents(watch) | events))
+		return false;
+
+	thread->fdEvents = events;
+	thread->readyEvents = 0;
+	watch->waiters.push_back(thread);
+	nWaiters++;
+	return true;
+}
+
+/**
+ * Removes a thread from the waiters of its file descriptor, if it is still there
+ * The registration is left armed, an event without waiters is ignored
+ * @param thread the thread
+ */
+void Poller::unwatch(Thread* thread)
+{
+	if (thread->queue != nullptr)
+	{
+		thread->queue->remove(thread);
+		nWaiters--;
+	}
+	thread->fdEvents = 0;
+}
+
+/**
+ * Waits until an event arrives or the poller is woken up, or until the timeout passes
+ * Returns early when a signal is delivered
+ * Doesn't change the waiters, so it may be called without the scheduler lock
+ * @param timeoutMs the timeout in milliseconds, 0 to poll, -1 to wait without a timeout
+ * @param events the array of POLL_EVENTS events to fill
+ * @return the number of events
+ */
+int Poller::wait(int timeoutMs, struct epoll_event* events)
+{
+	int n = epoll_wait(epollFd, events, POLL_EVENTS, timeoutMs);
+	return n > 0 ? n : 0;
+}
+
+/**
+ * Removes the threads whose events arrived from the waiters
+ * @param events the events returned by wait
+ * @param n the number of events
+ * @param ready the queue the threads are added to, with their readyEvents set
+ */
+void Poller::dispatch(const struct epoll_event* events, int n, ThreadQueue* ready)
+{
+	for (int i = 0; i < n; ++i)
+	{
+		int fd = events[i].data.fd;
+
+		// consume the wake ups
+		if (fd == wakeFd)
+		{
+			uint64_t count;
+			while (read(wakeFd, &count, sizeof(count)) > 0) {}
+			continue;
+		}
+		if (fd == attachedFd)
+			continue;
+
+		FdWatch* watch = fds[fd];
+		int arrived = fromEpoll(events[i].events);
+		Thread* thread = watch->waiters.front();
+		while (thread != nullptr)
+		{
+			Thread* next = thread->next;
+			if (thread->fdEvents & arrived)
+			{
+				watch->waiters.remove(thread);
+				nWaiters--;
+				thread->readyEvents = thread->fdEvents & arrived;
+				ready->push_back(thread);
+			}
+			thread = next;
+		}
+
+		// the one shot registration is disabled, register again for the remaining waiters
+		int waited = waitedEvents(watch);
+		if (waited != 0 && !arm(fd, watch, waited))
+		{
+			// the file descriptor was closed, fail the waits
+			while ((thread = watch->waiters.pop_front()) != nullptr)
+			{
+				nWaiters--;
+				thread->readyEvents = thread->fdEvents;
+				ready->push_back(thread);
+			}
+		}
+	}
+}
+
+/**
+ * Wakes up the kernel thread waiting in the poller, or makes its next wait return
+ * May be called by any kernel thread and from signal handlers
+ */
+void Poller::wake()
+{
+	uint64_t one = 1;
+	ssize_t ignored = write(wakeFd, &one, sizeof(one));  // fails only if the counter is saturated
+	(void)ignored;
+}
+
+/**
+ * Registers a file descriptor for the events of its waiters
+ * A file descriptor closed since it was added is no longer in the epoll instance, and
+ * one reopened with the same number isn't yet, so the registration falls back to add
+ * @param fd the file descriptor
+ * @param watch the waiters of the file descriptor
+ * @param events UTHREAD_FD_ events to register
+ * @return true if successful, otherwise false
+ */
+bool Poller::arm(int fd, FdWatch* watch, int events)
+{
+	struct epoll_event event;
+	event.events = toEpoll(events) | EPOLLONESHOT;
+	event.data.fd = fd;
+
+	if (watch->added && epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &event) == 0)
+		return true;
+	if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) == 0 ||
+		(errno == EEXIST && epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &event) == 0))
+	{
+		watch->added = true;
+		return true;
+	}
+
+	watch->added = false;
+	return false;
+}
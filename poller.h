@@ -0,0 +1,155 @@
+#ifndef UTHREADS_POLLER_H
+#define UTHREADS_POLLER_H
+
+#include <stdint.h>
+#include <vector>
+#include <sys/epoll.h>
+#include "thread.h"
+#include "threadqueue.h"
+
+/**
+ * Maximal number of events returned by one wait
+ */
+#define POLL_EVENTS 64
+
+
+/**
+ * Returns the epoll events of UTHREAD_FD_ events, they are also poll(2) events
+ */
+uint32_t toEpoll(int events);
+
+/**
+ * Returns the UTHREAD_FD_ events of epoll or poll(2) events
+ */
+int fromEpoll(uint32_t events);
+
+/**
+ * The threads waiting for events of a file descriptor
+ */
+struct FdWatch {
+
+	/**
+	 * The waiting threads
+	 */
+	ThreadQueue waiters;
+
+	/**
+	 * True if the file descriptor was added to the epoll instance
+	 */
+	bool added = false;
+};
+
+/**
+ * I/O reactor, waits for events while no thread can run
+ * An epoll instance with the file descriptors threads wait for, and an eventfd that
+ * wakes up the waiting kernel thread, so the idle scheduler sleeps until a resume
+ * source fires instead of spinning.
+ * A file descriptor is registered in one shot mode for the events its threads wait
+ * for, and registered again while threads still wait after an event
+ */
+struct Poller {
+
+	/**
+	 * Poller destructor
+	 */
+	~Poller();
+
+	/**
+	 * Creates the epoll instance and the wake up eventfd
+	 * Terminates the process if they can't be created
+	 */
+	void open();
+
+	/**
+	 * Adds a file descriptor whose readiness ends the wait, like a wake up
+	 * Its events aren't dispatched, the owner of the file descriptor handles them
+	 * Terminates the process if it can't be added
+	 * @param fd the file descriptor, polled for reading
+	 */
+	void attach(int fd);
+
+	/**
+	 * Adds a thread to the waiters of a file descriptor
+	 * @param thread the thread, not in any queue
+	 * @param fd the file descriptor
+	 * @param events the events to wait for, UTHREAD_FD_ values
+	 * @return true if successful, false if the file descriptor can't be polled (errno is set)
+	 */
+	bool watch(Thread* thread, int fd, int events);
+
+	/**
+	 * Removes a thread from the waiters of its file descriptor, if it is still there
+	 * @param thread the thread
+	 */
+	void unwatch(Thread* thread);
+
+	/**
+	 * Returns true if threads wait for file descriptor events
+	 */
+	bool watching() const
+	{
+		return nWaiters > 0;
+	}
+
+	/**
+	 * Waits until an event arrives or the poller is woken up, or until the timeout passes
+	 * Returns early when a signal is delivered
+	 * Doesn't change the waiters, so it may be called without the scheduler lock
+	 * @param timeoutMs the timeout in milliseconds, 0 to poll, -1 to wait without a timeout
+	 * @param events the array of POLL_EVENTS events to fill
+	 * @return the number of events
+	 */
+	int wait(int timeoutMs, struct epoll_event* events);
+
+	/**
+	 * Removes the threads whose events arrived from the waiters
+	 * @param events the events returned by wait
+	 * @param n the number of events
+	 * @param ready the queue the threads are added to, with their readyEvents set
+	 */
+	void dispatch(const struct epoll_event* events, int n, ThreadQueue* ready);
+
+	/**
+	 * Wakes up the kernel thread waiting in the poller, or makes its next wait return
+	 * May be called by any kernel thread and from signal handlers
+	 */
+	void wake();
+
+private:
+
+	/**
+	 * The epoll instance
+	 */
+	int epollFd = -1;
+
+	/**
+	 * The eventfd written by wake
+	 */
+	int wakeFd = -1;
+
+	/**
+	 * The file descriptor added by attach, -1 if none
+	 */
+	int attachedFd = -1;
+
+	/**
+	 * The waiters of every file descriptor, cell index == fd, allocated on first use
+	 */
+	std::vector<FdWatch*> fds;
+
+	/**
+	 * The number of threads waiting for file descriptor events
+	 */
+	int nWaiters = 0;
+
+	/**
+	 * Registers a file descriptor for the events of its waiters
+	 * @param fd the file descriptor
+	 * @param watch the waiters of the file descriptor
+	 * @param events UTHREAD_FD_ events to register
+	 * @return true if successful, otherwise false
+	 */
+	bool arm(int fd, FdWatch* watch, int events);
+};
+
+#endif //UTHREADS_POLLER_H
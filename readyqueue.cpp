@@ -0,0 +1,425 @@
+#include <iostream>
+#include <stdlib.h> // for exit()
+#include <time.h>
+#include "readyqueue.h"
+#include "messages.h"
+
+/**
+ * Returns the monotonic time in nanoseconds
+ */
+static long long now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * Returns the CPU time of the calling kernel thread in nanoseconds
+ * The time the kernel deschedules the worker isn't charged to the running thread
+ */
+static long long cpuTime()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+
+//------------------------------------------ LevelQueues -------------------------------------------------
+
+
+/**
+ * Adds a thread to the end of a level
+ * @param thread the thread to add
+ * @param level the level to add to
+ */
+void LevelQueues::push(Thread* thread, int level)
+{
+	levels[level].push_back(thread);
+	nonEmpty |= (uint32_t)1 << level;
+}
+
+/**
+ * Removes the first thread of the highest non empty level
+ * @return the removed thread, nullptr if all the levels are empty
+ */
+Thread* LevelQueues::pop()
+{
+	if (nonEmpty == 0)
+		return nullptr;
+
+	int level = __builtin_ctz(nonEmpty);
+	Thread* thread = levels[level].pop_front();
+	if (levels[level].empty())
+		nonEmpty &= ~((uint32_t)1 << level);
+	return thread;
+}
+
+/**
+ * Removes a thread from its level
+ * @param thread the thread to remove
+ */
+void LevelQueues::remove(Thread* thread)
+{
+	int level = (int)(thread->queue - levels);
+	levels[level].remove(thread);
+	if (levels[level].empty())
+		nonEmpty &= ~((uint32_t)1 << level);
+}
+
+
+//---------------------------------------- PriorityPolicy ------------------------------------------------
+
+
+/**
+ * Adds a thread to the end of its priority
+ * @param thread the thread to add
+ */
+void PriorityPolicy::push(Thread* thread)
+{
+	priorities.push(thread, thread->priority);
+}
+
+/**
+ * Removes the next thread to run
+ * @return the removed thread, nullptr if no thread is ready
+ */
+Thread* PriorityPolicy::pop()
+{
+	return priorities.pop();
+}
+
+/**
+ * Removes a thread from the ready threads
+ * @param thread the thread to remove
+ */
+void PriorityPolicy::remove(Thread* thread)
+{
+	priorities.remove(thread);
+}
+
+
+//---------------------------------------- FeedbackPolicy ------------------------------------------------
+
+
+/**
+ * Adds a thread to the end of its level
+ * @param thread the thread to add
+ * @param preempted true if the thread used its whole quantum
+ */
+void FeedbackPolicy::push(Thread* thread, bool preempted)
+{
+	if (thread->levelEpoch != epoch)
+	{
+		// boosted since the thread last became ready
+		thread->level = thread->priority;
+		thread->levelEpoch = epoch;
+	}
+	else if (preempted && thread->level < UTHREAD_PRIORITY_LEVELS - 1)
+	{
+		thread->level++;
+	}
+
+	levels.push(thread, thread->level);
+}
+
+/**
+ * Removes the next thread to run
+ * @return the removed thread, nullptr if no thread is ready
+ */
+Thread* FeedbackPolicy::pop()
+{
+	long long time = now();
+	if (nextBoost == 0)
+		nextBoost = time + boostPeriod;
+	if (time >= nextBoost)
+	{
+		boost();
+		nextBoost = time + boostPeriod;
+	}
+
+	return levels.pop();
+}
+
+/**
+ * Removes a thread from the ready threads
+ * @param thread the thread to remove
+ */
+void FeedbackPolicy::remove(Thread* thread)
+{
+	levels.remove(thread);
+}
+
+/**
+ * Sets the time between boosts
+ * @param usecs the boost period in microseconds
+ */
+void FeedbackPolicy::setBoostPeriod(long long usecs)
+{
+	boostPeriod = usecs * 1000;
+}
+
+/**
+ * Moves all the ready threads back to their priority
+ * The threads that aren't ready are moved when they become ready
+ */
+void FeedbackPolicy::boost()
+{
+	epoch++;
+
+	// keep the order of the threads, highest level first
+	ThreadQueue boosted;
+	Thread* thread;
+	while ((thread = levels.pop()) != nullptr)
+		boosted.push_back(thread);
+	while ((thread = boosted.pop_front()) != nullptr)
+		push(thread, false);
+}
+
+
+//------------------------------------------ FairPolicy --------------------------------------------------
+
+
+/**
+ * Adds a thread to the ready threads
+ * @param thread the thread to add
+ */
+void FairPolicy::push(Thread* thread)
+{
+	// new and woken threads compete from the current virtual time
+	if (thread->vruntime < minVruntime)
+		thread->vruntime = minVruntime;
+
+	heap.push_back(thread);  // within the reserved room
+	place(thread, heap.size() - 1);
+	fix(heap.size() - 1);
+}
+
+/**
+ * Removes the thread with the lowest virtual runtime
+ * @return the removed thread, nullptr if no thread is ready
+ */
+Thread* FairPolicy::pop()
+{
+	if (heap.empty())
+		return nullptr;
+
+	Thread* thread = heap[0];
+	remove(thread);
+	return thread;
+}
+
+/**
+ * Removes a thread from the ready threads
+ * @param thread the thread to remove
+ */
+void FairPolicy::remove(Thread* thread)
+{
+	size_t index = (size_t)thread->heapIndex;
+	Thread* last = heap.back();
+	heap.pop_back();
+	thread->heapIndex = -1;
+
+	// move the last item to the hole
+	if (last != thread)
+	{
+		place(last, index);
+		fix(index);
+	}
+}
+
+/**
+ * Called when a thread starts running
+ * @param thread the thread
+ */
+void FairPolicy::started(Thread* thread)
+{
+	if (thread->vruntime > minVruntime)
+		minVruntime = thread->vruntime;
+	thread->runStart = cpuTime();
+}
+
+/**
+ * Called when a thread stops running, charges the CPU time it ran
+ * @param thread the thread
+ */
+void FairPolicy::stopped(Thread* thread)
+{
+	long long ran = cpuTime() - thread->runStart;
+
+	// a thread with a longer quantum ages slower
+	if (thread->quantum != 0 && quantum != 0)
+		ran = ran * quantum / thread->quantum;
+	thread->vruntime += ran;
+}
+
+/**
+ * Sets the scheduler quantum, the weight of threads without a quantum of their own
+ * @param usecs the quantum length in microseconds, 0 if there is none
+ */
+void FairPolicy::setQuantum(int usecs)
+{
+	quantum = usecs;
+}
+
+/**
+ * Makes room for the given number of ready threads
+ * @param n the number of threads
+ */
+void FairPolicy::reserve(size_t n)
+{
+	try {
+		heap.reserve(n);
+	} catch (std::bad_alloc& e) {
+		std::cerr << SYS_ERR_HEADER << SYS_ERR_MEM_ALLOC;
+		exit(1);
+	}
+}
+
+/**
+ * Returns true if thread a runs before thread b
+ */
+bool FairPolicy::before(const Thread* a, const Thread* b)
+{
+	return a->vruntime < b->vruntime;
+}
+
+/**
+ * Places the heap item at the given index, moving it up or down
+ * @param index the heap index
+ */
+void FairPolicy::fix(size_t index)
+{
+	Thread* thread = heap[index];
+
+	// up
+	while (index > 0 && before(thread, heap[(index - 1) / 2]))
+	{
+		place(heap[(index - 1) / 2], index);
+		index = (index - 1) / 2;
+	}
+
+	// down
+	for (;;)
+	{
+		size_t child = 2 * index + 1;
+		if (child >= heap.size())
+			break;
+		if (child + 1 < heap.size() && before(heap[child + 1], heap[child]))
+			child++;
+		if (!before(heap[child], thread))
+			break;
+		place(heap[child], index);
+		index = child;
+	}
+
+	place(thread, index);
+}
+
+/**
+ * Stores a thread at a heap index
+ */
+void FairPolicy::place(Thread* thread, size_t index)
+{
+	heap[index] = thread;
+	thread->heapIndex = (int)index;
+}
+
+
+//------------------------------------------ ReadyQueue --------------------------------------------------
+
+
+/**
+ * Selects the scheduling policy
+ * Assumes no thread is ready
+ * @param policy one of the UTHREAD_SCHED_ values
+ * @param quantumUsecs the length of a quantum in microseconds, 0 if there is none
+ */
+void ReadyQueue::setPolicy(int policy, int quantumUsecs)
+{
+	this->policy = policy;
+
+	long long period = (long long)MLFQ_BOOST_QUANTA * quantumUsecs;
+	feedback.setBoostPeriod(period > MLFQ_BOOST_MIN_USECS ? period : MLFQ_BOOST_MIN_USECS);
+	fair.setQuantum(quantumUsecs);
+}
+
+/**
+ * Makes room for the given number of ready threads, so push() never allocates
+ * Only the fair policy allocates, the other policies link the threads
+ * @param n the number of threads
+ */
+void ReadyQueue::reserve(size_t n)
+{
+	if (policy == UTHREAD_SCHED_FAIR)
+		fair.reserve(n);
+}
+
+/**
+ * Changes the priority of a ready thread
+ * @param thread the thread
+ * @param priority the new priority
+ */
+void ReadyQueue::setPriority(Thread* thread, int priority)
+{
+	remove(thread);
+	thread->priority = priority;
+	thread->level = priority;
+	push(thread, false);
+}
+
+/**
+ * push() of the policies other than round robin
+ */
+void ReadyQueue::pushPolicy(Thread* thread, bool preempted)
+{
+	switch (policy)
+	{
+		case UTHREAD_SCHED_PRIORITY:
+			priority.push(thread);
+			break;
+		case UTHREAD_SCHED_MLFQ:
+			feedback.push(thread, preempted);
+			break;
+		case UTHREAD_SCHED_FAIR:
+			fair.push(thread);
+			break;
+	}
+}
+
+/**
+ * pop() of the policies other than round robin
+ */
+Thread* ReadyQueue::popPolicy()
+{
+	switch (policy)
+	{
+		case UTHREAD_SCHED_PRIORITY:
+			return priority.pop();
+		case UTHREAD_SCHED_MLFQ:
+			return feedback.pop();
+		case UTHREAD_SCHED_FAIR:
+			return fair.pop();
+	}
+	return nullptr;
+}
+
+/**
+ * remove() of the policies other than round robin
+ */
+void ReadyQueue::removePolicy(Thread* thread)
+{
+	switch (policy)
+	{
+		case UTHREAD_SCHED_PRIORITY:
+			priority.remove(thread);
+			break;
+		case UTHREAD_SCHED_MLFQ:
+			feedback.remove(thread);
+			break;
+		case UTHREAD_SCHED_FAIR:
+			fair.remove(thread);
+			break;
+	}
+}
@@ -0,0 +1,415 @@
+#ifndef UTHREADS_READYQUEUE_H
+#define UTHREADS_READYQUEUE_H
+
+#include <stdint.h>
+#include <vector>
+#include "uthreads.h"
+#include "thread.h"
+#include "threadqueue.h"
+
+/**
+ * The multi-level feedback queue boosts all the threads back to their priority
+ * every MLFQ_BOOST_QUANTA quantum lengths of wall-clock time
+ */
+#define MLFQ_BOOST_QUANTA 32
+
+/**
+ * Minimal boost period in microseconds, also used without a quantum (cooperative scheduling)
+ */
+#define MLFQ_BOOST_MIN_USECS 10000
+
+
+/**
+ * Round robin policy
+ * A single FIFO queue, threads run in the order they became ready
+ */
+struct RoundRobinPolicy {
+
+	/**
+	 * Adds a thread to the end of the queue
+	 * @param thread the thread to add
+	 */
+	void push(Thread* thread)
+	{
+		threads.push_back(thread);
+	}
+
+	/**
+	 * Removes the first thread of the queue
+	 * @return the removed thread, nullptr if the queue is empty
+	 */
+	Thread* pop()
+	{
+		return threads.pop_front();
+	}
+
+	/**
+	 * Removes a thread from the queue
+	 * @param thread the thread to remove
+	 */
+	void remove(Thread* thread)
+	{
+		threads.remove(thread);
+	}
+
+private:
+
+	/**
+	 * The ready threads
+	 */
+	ThreadQueue threads;
+};
+
+/**
+ * FIFO queues of threads by level, 0 is the highest level
+ * The non empty levels are kept in a bitmap, so the highest one is found in O(1)
+ */
+struct LevelQueues {
+
+	/**
+	 * Adds a thread to the end of a level
+	 * @param thread the thread to add
+	 * @param level the level to add to
+	 */
+	void push(Thread* thread, int level);
+
+	/**
+	 * Removes the first thread of the highest non empty level
+	 * @return the removed thread, nullptr if all the levels are empty
+	 */
+	Thread* pop();
+
+	/**
+	 * Removes a thread from its level
+	 * @param thread the thread to remove
+	 */
+	void remove(Thread* thread);
+
+private:
+
+	/**
+	 * The queue of every level
+	 */
+	ThreadQueue levels[UTHREAD_PRIORITY_LEVELS];
+
+	/**
+	 * Bit i is set if level i isn't empty
+	 */
+	uint32_t nonEmpty = 0;
+};
+
+/**
+ * Strict priority policy
+ * The threads of the highest priority run in round robin, lower priorities run
+ * only when no thread of a higher priority is ready
+ */
+struct PriorityPolicy {
+
+	/**
+	 * Adds a thread to the end of its priority
+	 * @param thread the thread to add
+	 */
+	void push(Thread* thread);
+
+	/**
+	 * Removes the next thread to run
+	 * @return the removed thread, nullptr if no thread is ready
+	 */
+	Thread* pop();
+
+	/**
+	 * Removes a thread from the ready threads
+	 * @param thread the thread to remove
+	 */
+	void remove(Thread* thread);
+
+private:
+
+	/**
+	 * The ready threads by priority
+	 */
+	LevelQueues priorities;
+};
+
+/**
+ * Multi-level feedback queue policy
+ * Threads start at the level of their priority, a thread that used its whole quantum
+ * drops a level, and a thread that gave up the CPU early keeps its level.
+ * Periodically all the threads are boosted back to their priority, so threads that
+ * dropped to the lowest levels don't starve
+ */
+struct FeedbackPolicy {
+
+	/**
+	 * Sets the time between boosts
+	 * @param usecs the boost period in microseconds
+	 */
+	void setBoostPeriod(long long usecs);
+
+	/**
+	 * Adds a thread to the end of its level
+	 * @param thread the thread to add
+	 * @param preempted true if the thread used its whole quantum
+	 */
+	void push(Thread* thread, bool preempted);
+
+	/**
+	 * Removes the next thread to run
+	 * @return the removed thread, nullptr if no thread is ready
+	 */
+	Thread* pop();
+
+	/**
+	 * Removes a thread from the ready threads
+	 * @param thread the thread to remove
+	 */
+	void remove(Thread* thread);
+
+private:
+
+	/**
+	 * The ready threads by level
+	 */
+	LevelQueues levels;
+
+	/**
+	 * The number of boosts so far, a thread whose level was set before the last boost
+	 * is moved back to its priority when it becomes ready
+	 */
+	unsigned int epoch = 0;
+
+	/**
+	 * The time between boosts in nanoseconds
+	 */
+	long long boostPeriod = 0;
+
+	/**
+	 * The time of the next boost in nanoseconds, 0 before the first pop
+	 */
+	long long nextBoost = 0;
+
+	/**
+	 * Moves all the ready threads back to their priority
+	 */
+	void boost();
+};
+
+/**
+ * Fair policy, like the Linux completely fair scheduler
+ * Every thread accumulates the time it ran as its virtual runtime, and the ready
+ * thread with the lowest virtual runtime runs next. Threads that become ready
+ * start from the lowest virtual runtime, so sleeping doesn't bank CPU time.
+ * The time is weighted by the quantum of the thread relative to the scheduler
+ * quantum, so a thread with a 3 times longer quantum gets 3 times the CPU time
+ */
+struct FairPolicy {
+
+	/**
+	 * Sets the scheduler quantum, the weight of threads without a quantum of their own
+	 * @param usecs the quantum length in microseconds, 0 if there is none
+	 */
+	void setQuantum(int usecs);
+
+	/**
+	 * Adds a thread to the ready threads
+	 * @param thread the thread to add
+	 */
+	void push(Thread* thread);
+
+	/**
+	 * Removes the thread with the lowest virtual runtime
+	 * @return the removed thread, nullptr if no thread is ready
+	 */
+	Thread* pop();
+
+	/**
+	 * Removes a thread from the ready threads
+	 * @param thread the thread to remove
+	 */
+	void remove(Thread* thread);
+
+	/**
+	 * Called when a thread starts running
+	 * @param thread the thread
+	 */
+	void started(Thread* thread);
+
+	/**
+	 * Called when a thread stops running, charges the CPU time it ran
+	 * @param thread the thread
+	 */
+	void stopped(Thread* thread);
+
+	/**
+	 * Makes room for the given number of ready threads
+	 * push() runs in the timer handler and mustn't allocate, so room for every
+	 * thread is made when the thread table grows
+	 * @param n the number of threads
+	 */
+	void reserve(size_t n);
+
+private:
+
+	/**
+	 * Binary min heap of the ready threads by virtual runtime, with room for every thread
+	 */
+	std::vector<Thread*> heap;
+
+	/**
+	 * The virtual runtime of the last thread that started running, never decreases
+	 */
+	long long minVruntime = 0;
+
+	/**
+	 * The scheduler quantum in microseconds
+	 */
+	int quantum = 0;
+
+	/**
+	 * Returns true if thread a runs before thread b
+	 */
+	static bool before(const Thread* a, const Thread* b);
+
+	/**
+	 * Places the heap item at the given index, moving it up or down
+	 * @param index the heap index
+	 */
+	void fix(size_t index);
+
+	/**
+	 * Stores a thread at a heap index
+	 */
+	void place(Thread* thread, size_t index);
+};
+
+/**
+ * The ready threads of the scheduler, ordered by the selected policy
+ * The round robin policy is inlined, the other policies are called through a switch
+ */
+struct ReadyQueue {
+
+	/**
+	 * Selects the scheduling policy
+	 * Assumes no thread is ready
+	 * @param policy one of the UTHREAD_SCHED_ values
+	 * @param quantumUsecs the length of a quantum in microseconds, 0 if there is none
+	 */
+	void setPolicy(int policy, int quantumUsecs);
+
+	/**
+	 * Changes the priority of a ready thread
+	 * @param thread the thread
+	 * @param priority the new priority
+	 */
+	void setPriority(Thread* thread, int priority);
+
+	/**
+	 * Makes room for the given number of ready threads, so push() never allocates
+	 * @param n the number of threads
+	 */
+	void reserve(size_t n);
+
+	/**
+	 * Adds a thread to the ready threads
+	 * @param thread the thread to add
+	 * @param preempted true if the thread is added after using its whole quantum
+	 */
+	void push(Thread* thread, bool preempted)
+	{
+		count++;
+		if (policy == UTHREAD_SCHED_RR)
+			roundRobin.push(thread);
+		else
+			pushPolicy(thread, preempted);
+	}
+
+	/**
+	 * Removes the next thread to run
+	 * @return the removed thread, nullptr if no thread is ready
+	 */
+	Thread* pop()
+	{
+		Thread* thread = policy == UTHREAD_SCHED_RR ? roundRobin.pop() : popPolicy();
+		if (thread != nullptr)
+			count--;
+		return thread;
+	}
+
+	/**
+	 * Removes a thread from the ready threads
+	 * @param thread the thread to remove
+	 */
+	void remove(Thread* thread)
+	{
+		count--;
+		if (policy == UTHREAD_SCHED_RR)
+			roundRobin.remove(thread);
+		else
+			removePolicy(thread);
+	}
+
+	/**
+	 * Returns the number of ready threads
+	 */
+	int size() const
+	{
+		return count;
+	}
+
+	/**
+	 * Called when a thread starts running
+	 * @param thread the thread
+	 */
+	void started(Thread* thread)
+	{
+		if (policy == UTHREAD_SCHED_FAIR)
+			fair.started(thread);
+	}
+
+	/**
+	 * Called when a thread stops running
+	 * @param thread the thread
+	 */
+	void stopped(Thread* thread)
+	{
+		if (policy == UTHREAD_SCHED_FAIR)
+			fair.stopped(thread);
+	}
+
+private:
+
+	/**
+	 * The selected policy
+	 */
+	int policy = UTHREAD_SCHED_RR;
+
+	/**
+	 * The number of ready threads
+	 */
+	int count = 0;
+
+	/**
+	 * The ready threads of every policy, only the selected one is used
+	 */
+	RoundRobinPolicy roundRobin;
+	PriorityPolicy priority;
+	FeedbackPolicy feedback;
+	FairPolicy fair;
+
+	/**
+	 * push() of the policies other than round robin
+	 */
+	void pushPolicy(Thread* thread, bool preempted);
+
+	/**
+	 * pop() of the policies other than round robin
+	 */
+	Thread* popPolicy();
+
+	/**
+	 * remove() of the policies other than round robin
+	 */
+	void removePolicy(Thread* thread);
+};
+
+#endif //UTHREADS_READYQUEUE_H
@@ -1,29 +1,119 @@
 #include <iostream>
+#include <errno.h>
+#include <stdio.h>  // for fflush()
 #include <stdlib.h> // for exit()
+#include <string.h>
 #include <sys/time.h>
 #include <signal.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <atomic>
 #include "scheduler.h"
 #include "messages.h"
 
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
 /**
  * The signal number used when the scheduler calls the switch thread function
  */
 #define SCHED_SWITCH_SIG 0
 
+/**
+ * Number of terminated threads the idle loop of a worker reaps together
+ */
+#define REAP_BATCH 16
+
+/**
+ * Number of lock free steal attempts an idle worker makes before it sleeps
+ */
+#define IDLE_STEAL_ATTEMPTS 64
+
+/**
+ * With tickless scheduling the quantum is stretched while at most this many threads are ready
+ */
+#define ADAPTIVE_SHORT_QUEUE 1
+
+/**
+ * Stack size of the idle loop of worker 0
+ */
+#define IDLE_STACK_SIZE 65536
+
+/**
+ * Minimal time between two polls of the file descriptors at thread switches, in microseconds
+ */
+#define POLL_INTERVAL_USECS 200
+
+
+/**
+ * The thread running on this kernel thread, nullptr while the worker is idle
+ * A thread reads it with a single load, so the value is right even if the thread
+ * migrates to another worker right after
+ */
+static thread_local Thread* currentThread = nullptr;
+
+/**
+ * The worker of this kernel thread
+ */
+static thread_local Worker* currentWorker = nullptr;
+
 
 //------------------------------------- Function declarations --------------------------------------------
 
 
 /**
 * Switch to the next ready thread in the scheduler ready list.
+* Must be called inside a critical section
 * @param sig signal id
 */
 static void switchThread(int sig);
 
 /**
- * Returns the next thread in the scheduler ready list
+ * SIGVTALRM handler
+ * Switches threads, or defers the switch if the tick arrived inside a critical section
+ * @param sig signal id
+ */
+static void timerHandler(int sig);
+
+/**
+ * Runs a thread on a worker
+ * Must be called inside a critical section
+ * @param w the worker that runs the thread
+ * @param from the context to save the current execution in
+ * @param thread the thread to run
+ * @param donated true if the thread gets the rest of the current quantum instead of a new slice
+ */
+static void runThread(Worker* w, Context* from, Thread* thread, bool donated = false);
+
+/**
+ * Idle loop of a worker
+ * Runs the ready threads, and parks the worker when there are none
+ * In M:N mode runs with the scheduler lock held, like a thread that was switched to
+ * @param arg the worker
+ */
+static void workerLoop(void* arg);
+
+/**
+ * Entry point of the kernel thread of workers 1 and up
+ * @param arg the worker
+ * @return never returns
  */
-static Thread* nextThread();
+static void* workerMain(void* arg);
+
+/**
+ * Sets the action taken on SIGVTALRM
+ * @param handler the signal handler
+ */
+static void setTimerHandler(void (*handler)(int));
+
+/**
+ * Tells the scheduler an offloaded call returned, called by the offload pool threads
+ */
+static void offloadReturned();
 
 
 //------------------------------------------ Constructor -------------------------------------------------
@@ -31,19 +121,11 @@ static Thread* nextThread();
 
 /**
  * Constructor
- * Initializes arrays
+ * Sets the default thread limit
  */
 Scheduler::Scheduler()
 {
-	// initialize arrays
-	int i, j;
-	for (i = 0; i < MAX_THREAD_NUM; ++i)
-	{
-		for (j = 0; j < MAX_THREAD_NUM; ++j)
-			syncMatrix[i][j] = 0;
-		threadArray[i] = nullptr;
-		numSyncedThreads[i] = 0;
-	}
+	tids.setLimit(MAX_THREAD_NUM);
 }
 
 
@@ -70,7 +152,150 @@ void Scheduler::setQuantumLength(int quantum_usecs)
 }
 
 /**
- * Add a thread to the scheduler thread list
+ * Set the scheduling policy
+ * Assumes the quantum length is already set
+ * @param policy one of the UTHREAD_SCHED_ values
+ */
+void Scheduler::setPolicy(int policy)
+{
+	readyList.setPolicy(policy, quantum_usecs);
+	readyList.reserve(threadArray.size());
+}
+
+/**
+ * Set tickless scheduling with a single worker
+ * The timer is stopped while a single thread can run, and optionally the quantum is
+ * stretched up to maxQuantum while few threads are ready
+ * @param tickless true for tickless scheduling
+ * @param maxQuantum the maximal stretched quantum in microseconds, 0 for no stretching
+ */
+void Scheduler::setTickless(bool tickless, int maxQuantum)
+{
+	this->tickless = tickless;
+	this->maxQuantum = maxQuantum;
+}
+
+/**
+ * Set cooperative scheduling, without a quantum timer and a signal handler
+ * Threads switch only when they yield, block, sync or terminate
+ * @param cooperative true for cooperative scheduling
+ */
+void Scheduler::setCooperative(bool cooperative)
+{
+	this->cooperative = cooperative;
+}
+
+/**
+ * Set the clock quanta are measured on
+ * Wall-clock quanta use a timer of every worker, also with a single worker
+ * @param clock one of the UTHREAD_CLOCK_ values
+ */
+void Scheduler::setClock(int clock)
+{
+	monotonic = clock == UTHREAD_CLOCK_MONOTONIC;
+}
+
+/**
+ * Set the backend of the thread I/O calls
+ * The io_uring ring is set up by start, the epoll backend is kept if that fails
+ * @param backend one of the UTHREAD_IO_ values
+ */
+void Scheduler::setIoBackend(int backend)
+{
+	uring = backend == UTHREAD_IO_URING;
+}
+
+/**
+ * Set the maximal number of kernel threads running offloaded calls
+ * The pool threads are started when calls are offloaded
+ * @param maxThreads the maximal number of offload threads
+ */
+void Scheduler::setOffloadThreads(int maxThreads)
+{
+	offloads.configure(maxThreads, offloadReturned);
+}
+
+/**
+ * Set the maximal number of concurrent threads
+ * @param maxThreads the maximal number of threads, 0 for no limit
+ * @param initialThreads the number of thread table cells to allocate in advance
+ */
+void Scheduler::setThreadLimit(int maxThreads, int initialThreads)
+{
+	try {
+		tids.setLimit(maxThreads);
+		tids.reserve(initialThreads);
+		threadArray.resize(tids.capacity(), nullptr);
+		exits.resize(tids.capacity());
+		readyList.reserve(tids.capacity());
+	} catch (std::bad_alloc& e) {
+		std::cerr << SYS_ERR_HEADER << SYS_ERR_MEM_ALLOC;
+		exit(1);
+	}
+}
+
+/**
+ * Set the number of workers, the calling kernel thread becomes worker 0
+ * @param n the number of workers
+ */
+void Scheduler::setWorkers(int n)
+{
+	try {
+		workers = new Worker[n];
+	} catch (std::bad_alloc& e) {
+		std::cerr << SYS_ERR_HEADER << SYS_ERR_MEM_ALLOC;
+		exit(1);
+	}
+	nWorkers = n;
+	for (int i = 0; i < n; ++i)
+		workers[i].index = i;
+
+	reserveRunQueues();
+
+	currentWorker = &workers[0];
+	workers[0].pthread = pthread_self();
+	workers[0].kernelTid = (pid_t)syscall(SYS_gettid);
+
+	// worker 0 runs the main thread on its kernel thread stack, its idle loop gets a stack of its own
+	if (!workers[0].idleStack.allocate(IDLE_STACK_SIZE))
+	{
+		std::cerr << SYS_ERR_HEADER << SYS_ERR_STACK_ALLOC;
+		exit(1);
+	}
+	contextInit(&workers[0].idleContext, workers[0].idleStack.base, workers[0].idleStack.size,
+				workerLoop, &workers[0]);
+}
+
+/**
+ * Starts scheduling with the main thread running on the calling kernel thread
+ * Starts the quantum timer and the other workers
+ * Takes ownership of the thread
+ * @param mainThread the main thread
+ */
+void Scheduler::start(Thread* mainThread)
+{
+	threadArray[mainThread->id] = mainThread;
+
+	// the main thread starts inside a critical section, like every thread that is switched to
+	currentThread = mainThread;
+	mainThread->worker = worker();
+	mainThread->state = RUNNING;
+	readyList.started(mainThread);  // the fair policy charges the main thread from now on
+	if (nWorkers > 1)
+		schedLock.lock();
+
+	poller.open();
+	if (uring && ring.open(IO_RING_ENTRIES))
+		poller.attach(ring.fd());  // idle workers wait for the completions in the poller
+	initializeTimer();
+	switchThread(SCHED_SWITCH_SIG);
+	startWorkers();
+
+	unblockTimerThreadSwitch();
+}
+
+/**
+ * Add a thread to the scheduler thread list and make it ready
  * Takes ownership of the thread
  * Assumes a valid thread is added
  * @param thread the thread to add to the scheduler thread list
@@ -78,30 +303,79 @@ void Scheduler::setQuantumLength(int quantum_usecs)
 void Scheduler::add(Thread* thread)
 {
 	threadArray[thread->id] = thread;
-	readyList.push_back(thread);
+	makeReady(thread, false);
+}
 
-	if (thread->id == MAIN_THREAD_ID)
-	{
-		thread->state = RUNNING;
-		running = thread;
-		initializeTimer();
-		switchThread(SCHED_SWITCH_SIG);
-	}
+/**
+ * Returns the thread running on the calling worker, nullptr if the worker is idle
+ */
+Thread* Scheduler::current() const
+{
+	return currentThread;
+}
+
+/**
+ * Returns the calling worker
+ */
+Worker* Scheduler::worker() const
+{
+	return currentWorker;
 }
 
 /**
- * Returns a free thread ID
+ * Returns the monotonic time in microseconds, the clock of the wait deadlines
+ */
+long long Scheduler::clock()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+/**
+ * Reserves the lowest free thread ID
+ * The ID is freed when the thread is terminated
  * @return thread id number, if no available id's returns -1
  */
-int Scheduler::id() const
+int Scheduler::id()
+{
+	int tid;
+	try {
+		tid = tids.allocate();
+
+		// grow the thread array with the id bitmap
+		if (tid != -1 && (size_t)tid >= threadArray.size())
+		{
+			threadArray.resize(tids.capacity(), nullptr);
+			exits.resize(tids.capacity());
+			readyList.reserve(tids.capacity());  // the timer handler pushes without allocating
+			reserveRunQueues();
+		}
+	} catch (std::bad_alloc& e) {
+		std::cerr << SYS_ERR_HEADER << SYS_ERR_MEM_ALLOC;
+		exit(1);
+	}
+
+	return tid;  // -1 if the thread limit is reached
+}
+
+/**
+ * Frees a thread ID reserved by id() that no thread was created with
+ * @param tid the thread id
+ */
+void Scheduler::releaseId(int tid)
 {
-	int i;
-	// iterate over the thread array and find the first empty cell
-	for (i = 0; i < MAX_THREAD_NUM; ++i)
-		if (threadArray[i] == nullptr)
-			return i;
+	tids.release(tid);
+}
 
-	return -1;  // Thread pool is full
+/**
+ * Check if a thread exists
+ * @param tid thread id number
+ * @return true if a thread with the given id exists, otherwise false
+ */
+bool Scheduler::exists(int tid) const
+{
+	return tid >= 0 && (size_t)tid < threadArray.size() && threadArray[tid] != nullptr;
 }
 
 /**
@@ -111,7 +385,7 @@ int Scheduler::id() const
  */
 int Scheduler::quantums(int tid) const
 {
-	if (tid < 0 || tid >= MAX_THREAD_NUM || threadArray[tid] == nullptr)
+	if (!exists(tid))
 		return -1;
 
 	return threadArray[tid]->nQuantum;
@@ -125,7 +399,7 @@ int Scheduler::quantums(int tid) const
  */
 int Scheduler::terminate(int tid)
 {
-	if (tid < 0 || tid >= MAX_THREAD_NUM || threadArray[tid] == nullptr)
+	if (!exists(tid))
 		return -1;  // thread doesn't exist
 
 	// if main thread is terminated free all memory and exit
@@ -133,27 +407,30 @@ int Scheduler::terminate(int tid)
 		end();  // free memory and exit
 
 	Thread* thread = threadArray[tid];
+	bool self = thread == currentThread;
 
-	if (running->id == tid)
-		running = nullptr;
-
-	// remove from thread array
-	threadArray[tid] = nullptr;
-
-	// remove blocks on synced threads
-	unsync(tid);
-
-	// remove from ready list
-	removeFromReadyList(tid);
+	// a thread running on another worker, or queued in a run queue, leaves the thread
+	// table now, and is retired by the worker that switches it out or takes it next
+	if (!self && (thread->worker != nullptr || (thread->queued && nWorkers > 1)))
+	{
+		thread->terminating = true;
+		if (thread->worker == nullptr)
+		{
+			// the id may be reused while the thread is still queued
+			unclaimed++;
+			reserveRunQueues();
+		}
+		unregister(thread);
+		if (thread->worker != nullptr)
+			kick(thread);
+		return 0;
+	}
 
-	// free allocated memory
-	delete thread;
+	retire(thread);
 
 	// if the running thread was terminated then switch threads
-	if (running == nullptr) {
-		unblockTimerThreadSwitch(); // unblock timer signal
+	if (self)
 		switchThread(SCHED_SWITCH_SIG);
-	}
 
 	return 0;
 }
@@ -167,23 +444,23 @@ int Scheduler::terminate(int tid)
 int Scheduler::block(int tid)
 {
 	// thread doesn't exist or trying to block the main thread
-	if (tid < 0 || tid >= MAX_THREAD_NUM || tid == MAIN_THREAD_ID || threadArray[tid] == nullptr)
+	if (!exists(tid) || tid == MAIN_THREAD_ID)
 		return -1;
 
 	if (threadArray[tid]->state == BLOCKED)
 		return 0;
 
-	threadArray[tid]->state = BLOCKED;
+	Thread* thread = threadArray[tid];
+	thread->state = BLOCKED;
 
-	//remove from ready list
+	// remove from ready list, a thread in a run queue is dropped by the worker that takes it
 	removeFromReadyList(tid);
 
 	// switch thread if the running thread was blocked
-	if (threadArray[tid] == running)
-	{
-		unblockTimerThreadSwitch();
+	if (thread == currentThread)
 		switchThread(SCHED_SWITCH_SIG);
-	}
+	else if (thread->worker != nullptr)
+		kick(thread);  // running on another worker
 
 	return 0;
 }
@@ -195,249 +472,1856 @@ int Scheduler::block(int tid)
  */
 int Scheduler::resume(int tid)
 {
-	if (tid < 0 || tid >= MAX_THREAD_NUM || threadArray[tid] == nullptr)
+	if (!exists(tid))
 		return -1;  // requested thread doesn't exist
 
 
 	Thread* thread = threadArray[tid];
-	thread->state = READY;        // change thread state to READY
+	if (thread->state != BLOCKED)
+		return 0;   // resuming a running or ready thread has no effect
 
-	// don't put back in ready list if the thread is synced
-	if (numSyncedThreads[tid] != 0)
+	// a thread blocked while running on another worker may not have been switched out yet
+	if (thread->worker != nullptr)
+	{
+		thread->state = RUNNING;
 		return 0;
+	}
 
-	// make sure thread isn't in the ready list before adding it back
-	auto b = readyList.begin();
-	for (; b != readyList.end() && (*b)->id != tid; ++b)
-		;
+	thread->state = READY;        // change thread state to READY
 
-	if (b == readyList.end())
-		readyList.push_back(threadArray[tid]);  // add thread to ready list
+	// add back to the ready threads unless synced or still queued
+	makeRunnable(thread, false);
 
 	return 0;
 }
 
 /**
- * Blocks the running thread until the requested thread state changes to RUNNING
- * @param tid thread id number
- * @return 0 if successful, otherwise -1
+ * Queues the resume of a blocked thread, the scheduler resumes it when it takes the next thread
+ * May be called from signal handlers and from kernel threads that don't run a thread,
+ * so only lock free operations and async signal safe system calls are used
+ * @param tid the thread to resume
+ * @return 0 if queued, -1 if tid is negative or too many resumes are queued
  */
-int Scheduler::sync(int tid)
+int Scheduler::resumeAsync(int tid)
 {
-	if (tid < 0 || tid >= MAX_THREAD_NUM || threadArray[tid] == nullptr)
-		return -1;  // thread doesn't exist
-	if (running->id == MAIN_THREAD_ID)
-		return -1;  // main thread can't sync
+	if (tid < 0 || !asyncResumes.push(tid))
+		return -1;
+
+	wakeIdle();
+	return 0;
+}
 
-	// update the sync arrays
-	if (syncMatrix[tid][running->id] != 1)  // don't count the same thread twice in sync arrays
+/**
+ * Wakes up the idle workers so they collect the wake ups queued from other kernel threads
+ * A running worker collects them at its next switch
+ * May be called from signal handlers and from kernel threads that don't run a thread,
+ * so only lock free operations and async signal safe system calls are used
+ */
+void Scheduler::wakeIdle()
+{
+	poller.wake();
+	if (nWorkers > 1)
 	{
-		syncMatrix[tid][running->id] = 1;
-		numSyncedThreads[running->id]++;
+		wakeSequence.fetch_add(1, std::memory_order_seq_cst);
+		syscall(SYS_futex, &wakeSequence, FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
 	}
+}
 
-	unblockTimerThreadSwitch();
+/**
+ * Moves the running thread to the end of the ready threads and switches threads
+ */
+void Scheduler::yield()
+{
 	switchThread(SCHED_SWITCH_SIG);
-
-	return 0;
 }
 
 /**
- * Removes all blocks caused by a sync with the given thread
+ * Switches to the requested thread, the running thread goes to the end of the ready threads
+ * The requested thread gets the rest of the current quantum. A thread that isn't ready,
+ * or that is in the run queue of a worker (M:N mode), runs in its turn
+ * @param tid the thread id
+ * @return 0 if successful, -1 if the thread doesn't exist
  */
-void Scheduler::unsync(int tid)
+int Scheduler::yieldTo(int tid)
 {
-	int i;
-	for (i = 0; i < MAX_THREAD_NUM; ++i)
-	{
-		Thread* thread = threadArray[i];
-
-		// remove sync blocks made by the given thread
-		if (syncMatrix[tid][i] != 0)
-			numSyncedThreads[i]--;
-		syncMatrix[tid][i] = 0;
+	if (!exists(tid))
+		return -1;
 
-		// add non blocked threads back to ready list
-		if (thread != nullptr && numSyncedThreads[i] == 0 && thread->state != BLOCKED && !inReadyList(i))
+	Thread* target = threadArray[tid];
+	if (target != currentThread && target->queued)
+	{
+		if (nWorkers == 1)
 		{
-			readyList.push_back(threadArray[i]);
+			removeFromReadyList(tid);
+			setRunNext(worker(), target);
 		}
-
-		// if thread was terminated other threads should not block this tid
-		if (threadArray[tid] == nullptr)
+		else
 		{
-			syncMatrix[i][tid] = 0;
-			numSyncedThreads[tid] = 0;
+			// a thread handed off to on another worker can be taken over, the run queues
+			// can only be taken from their ends
+			for (int i = 0; i < nWorkers; ++i)
+			{
+				if (workers[i].runNext == target && target->state != BLOCKED && !target->terminating)
+				{
+					workers[i].runNext = nullptr;
+					setRunNext(worker(), target);
+					break;
+				}
+			}
 		}
 	}
+
+	switchThread(SCHED_SWITCH_SIG);
+	return 0;
 }
 
 /**
- * Block the timer based thread switch
- * Ignores the SIGVTALRM signal
+ * Makes the running thread wait for at least the given time
+ * The thread is woken up by the first scheduling decision after the time passed
+ * @param usecs the time in microseconds
+ * @return 0 if successful, -1 if the time is negative
  */
-void Scheduler::blockTimerThreadSwitch()
+int Scheduler::sleep(int usecs)
 {
-	if (signal(SIGVTALRM, SIG_IGN) == SIG_ERR)
-	{
-		std::cerr << SYS_ERR_HEADER << SYS_ERR_SIG_ACTION;
-		exit(1);
-	};
+	if (usecs < 0)
+		return -1;
+
+	suspend(clock() + usecs);
+	return 0;
 }
 
 /**
- * Unblock the timer based thread switch
- * Restores the SIGVTALRM handler
+ * Makes the running thread wait until it is woken up, or until the deadline
+ * Must be called inside a critical section
+ * @param deadline the deadline on the clock() time line, -1 for no deadline
+ * @return true if the deadline passed before the thread was woken up
  */
-void Scheduler::unblockTimerThreadSwitch()
+bool Scheduler::suspend(long long deadline)
 {
-	if (signal(SIGVTALRM, switchThread) == SIG_ERR)
-	{
-		std::cerr << SYS_ERR_HEADER << SYS_ERR_SIG_ACTION;
-		exit(1);
-	};
-}
+	Thread* thread = currentThread;
+	thread->waiting = true;
+	thread->timedOut = false;
+	if (deadline >= 0)
+		timers.add(&thread->timer, deadline, clock());
 
+	switchThread(SCHED_SWITCH_SIG);
 
-//------------------------------------- Private Methods --------------------------------------------
-
+	return thread->timedOut;
+}
 
 /**
- * Initialize the quantum timer
+ * Makes the running thread wait until a file descriptor is ready, or until the timeout
+ * Must be called inside a critical section
+ * @param fd the file descriptor
+ * @param events the UTHREAD_FD_ events to wait for
+ * @param timeoutUsecs the timeout in microseconds, -1 for no timeout
+ * @return the ready events, 0 if the timeout passed, -1 if fd can't be waited for
  */
-void Scheduler::initializeTimer()
+int Scheduler::waitFd(int fd, int events, int timeoutUsecs)
 {
-	struct sigaction sa;
-	struct itimerval timer;
-	sa.sa_handler = &switchThread;
-
-	// initialize variables
-	sa.sa_flags = 0;
-	sigemptyset(&sa.sa_mask);
+	if (fd < 0 || events == 0 || (events & ~(UTHREAD_FD_READ | UTHREAD_FD_WRITE)) != 0)
+	{
+		errno = EINVAL;
+		return -1;
+	}
 
-	if (sigaction(SIGVTALRM, &sa, NULL) < 0) {
-		std::cerr << SYS_ERR_HEADER << SYS_ERR_SIG_ACTION;
-		exit(1);
+	// with io_uring the poll is submitted with the other entries, no epoll_ctl call per wait
+	int result;
+	if (ringIo(IORING_OP_POLL_ADD, fd, nullptr, 0, 0, toEpoll(events),
+			   timeoutUsecs < 0 ? -1 : clock() + timeoutUsecs, &result))
+	{
+		if (result == -ECANCELED)
+			return 0;
+		if (result < 0)
+		{
+			errno = -result;
+			return -1;
+		}
+		return fromEpoll((uint32_t)result) & events;
 	}
 
-	// Configure the timer to expire after 1 sec... */
-	timer.it_value.tv_sec = 0;        // first time interval, seconds part
-	timer.it_value.tv_usec = quantum_usecs;        // first time interval, microseconds part
+	Thread* thread = currentThread;
+	if (!poller.watch(thread, fd, events))
+		return -1;
 
-	// configure the timer to expire every 3 sec after that.
-	timer.it_interval.tv_sec = 0;    // following time intervals, seconds part
-	timer.it_interval.tv_usec = quantum_usecs;    // following time intervals, microseconds part
+	suspend(timeoutUsecs < 0 ? -1 : clock() + timeoutUsecs);
 
-	// Start a virtual timer. It counts down whenever this process is executing.
-	if (setitimer(ITIMER_VIRTUAL, &timer, NULL)) {
-		std::cerr << SYS_ERR_HEADER << SYS_ERR_TIMER;
-		exit(1);
-	}
+	// still a waiter if the timeout passed
+	poller.unwatch(thread);
+	return thread->readyEvents;
 }
 
 /**
- * Check if a thread is in the ready list
- * @param tid the thread to search in the ready list
- * @return true if in the ready list, otherwise false
+ * Makes an I/O call on the io_uring ring, the running thread waits for its completion
+ * The entry is submitted with the entries of the other threads, at the end of the round
+ * Must be called inside a critical section
+ * @param opcode the IORING_OP_ operation
+ * @param fd the file descriptor
+ * @param addr the buffer, or the operation specific address
+ * @param len the buffer length
+ * @param offset the file offset, or the operation specific value
+ * @param flags the operation specific flags
+ * @param deadline the deadline on the clock() time line, -1 for no deadline
+ * @param result set to the result of the call, -errno on failure, -ECANCELED if the
+ * deadline passed
+ * @return true if the call was made, false if the ring isn't set up or is full
  */
-bool Scheduler::inReadyList(int tid) const
+bool Scheduler::ringIo(int opcode, int fd, const void* addr, unsigned len, unsigned long long offset,
+					   unsigned flags, long long deadline, int* result)
 {
-	auto b = readyList.begin();
-	for (; b != readyList.end() && (*b)->id != tid; ++b)
-		;
-	if (b == readyList.end())
+	Thread* thread = currentThread;
+	if (!ring.active() || !ring.prepare(thread, opcode, fd, addr, len, offset, flags))
 		return false;
 
+	// with no thread to batch the call with it is submitted at once, and the thread keeps
+	// running if the call completed right away
+	if (submitDue())
+	{
+		submitIo();
+		completeIo();
+	}
+
+	// the kernel may still use the buffer after the deadline, wait for the cancelled call
+	if (thread->ioPending && suspend(deadline) && thread->ioPending)
+		ring.cancel(thread);
+	while (thread->ioPending)
+		suspend(-1);
+
+	*result = thread->ioResult;
 	return true;
 }
 
 /**
- * Removes the requested thread from the ready list
- * @param tid the id of the thread to remove from the ready list
+ * Makes the running thread wait on an address if it holds the expected value, until
+ * wakeAddress wakes it up or until the timeout
+ * The waiter is counted before the value is checked, so a thread that changes the value
+ * and then wakes the address sees it, even when the wake takes no critical section
+ * Must be called inside a critical section
+ * @param addr the address
+ * @param expected the value the address must hold
+ * @param timeoutUsecs the timeout in microseconds, -1 for no timeout
+ * @return 0 if woken up, -1 with errno set to EAGAIN if the value isn't expected, or
+ * to ETIMEDOUT if the timeout passed
  */
- void Scheduler::removeFromReadyList(int tid)
+int Scheduler::waitAddress(const int* addr, int expected, int timeoutUsecs)
 {
-	for (auto b = readyList.begin(); b != readyList.end(); ++b)
+	WaitBucket* bucket = waitBucket(addr);
+	__atomic_add_fetch(&bucket->nWaiting, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(addr, __ATOMIC_SEQ_CST) != expected)
 	{
-		if ((*b)->id == tid)
-		{
-			readyList.erase(b);
-			break;
-		}
+		__atomic_sub_fetch(&bucket->nWaiting, 1, __ATOMIC_RELAXED);
+		errno = EAGAIN;
+		return -1;
+	}
+
+	Thread* thread = currentThread;
+	thread->waitAddr = addr;
+	bucket->waiters.push_back(thread);
+
+	// wakeAddress and expireTimers take the thread out of the wait queue before waking it up
+	long long deadline = timeoutUsecs < 0 ? -1 : clock() + timeoutUsecs;
+	bool timedOut = false;
+	while (thread->waitAddr != nullptr)
+		timedOut = suspend(deadline);
+
+	if (timedOut)
+	{
+		errno = ETIMEDOUT;
+		return -1;
 	}
+	return 0;
 }
 
 /**
- * Free all the allocated memory and terminate the program with exit()
- * Called when main thread is terminated
+ * Wakes up the threads waiting on an address, in the order they started waiting
+ * A single woken thread is handed off to, like the waiter of a mutex
+ * Must be called inside a critical section
+ * @param addr the address
+ * @param n the maximal number of threads to wake up
+ * @return the number of woken up threads
  */
-void Scheduler::end()
+int Scheduler::wakeAddress(const int* addr, int n)
 {
-	// free all allocated memory
-	unsigned int i;
-	for (i = 1; i < MAX_THREAD_NUM; ++i)
+	WaitBucket* bucket = waitBucket(addr);
+	int woken = 0;
+	Thread* thread = bucket->waiters.front();
+	while (thread != nullptr && woken < n)
 	{
-		if (threadArray[i] != nullptr)
-			delete threadArray[i];
+		Thread* next = thread->next;
+		if (thread->waitAddr == addr)
+		{
+			leaveWaitTable(thread);
+			wake(thread, n == 1);
+			woken++;
+		}
+		thread = next;
 	}
-	delete threadArray[MAIN_THREAD_ID];  // free main thread
-	exit(0);
+	return woken;
 }
 
-
-//------------------------------------- Static functions --------------------------------------------
-
+/**
+ * Returns the wait queue of an address
+ * @param addr the address
+ */
+WaitBucket* Scheduler::waitBucket(const int* addr)
+{
+	// Fibonacci hashing, the low bits of an int address are always 0
+	uintptr_t key = (uintptr_t)addr >> 2;
+	return &waitTable[(key * 2654435761u) % WAIT_TABLE_SIZE];
+}
 
 /**
-* Jump to the next ready thread in the scheduler ready list.
-* @param sig signal id
-*/
-static void switchThread(int sig)
+ * Removes a thread from the wait queue of the address it waits on
+ * Must be called inside a critical section
+ * @param thread the thread, waits on an address
+ */
+void Scheduler::leaveWaitTable(Thread* thread)
 {
-	static Scheduler* scheduler = Scheduler::instance();
-	scheduler->blockTimerThreadSwitch();    // block timer signal in critical code
+	WaitBucket* bucket = waitBucket(thread->waitAddr);
+	bucket->waiters.remove(thread);
+	__atomic_sub_fetch(&bucket->nWaiting, 1, __ATOMIC_RELAXED);
+	thread->waitAddr = nullptr;
+}
 
-	Thread* running = scheduler->running;
+/**
+ * Runs a blocking call on a kernel thread of the offload pool, the running thread
+ * waits until it returns
+ * Must be called inside a critical section
+ * @param fn the function to call
+ * @param arg the argument of the function
+ * @return the return value of the function, errno is set to the errno it left
+ */
+void* Scheduler::offload(void* (*fn)(void*), void* arg)
+{
+	Thread* thread = currentThread;
+	thread->offloadFn = fn;
+	thread->offloadArg = arg;
+	nOffloads++;
+	offloads.submit(thread);
+
+	// drainOffloads clears the call once it returned
+	while (thread->offloadFn != nullptr)
+		suspend(-1);
+
+	errno = thread->offloadErrno;
+	return thread->offloadResult;
+}
+
+/**
+ * Wakes up a waiting thread, it runs again unless it is blocked
+ * Waking up a thread that isn't waiting has no effect
+ * A thread handed off to runs as soon as the running thread switches out, so a peer
+ * that answers doesn't wait behind all the ready threads. In M:N mode an idle worker
+ * runs it instead, if there is one
+ * @param thread the thread to wake up
+ * @param handoff true to run the thread next on the calling worker, ahead of the
+ * ready threads
+ */
+void Scheduler::wake(Thread* thread, bool handoff)
+{
+	if (!thread->waiting)
+		return;
+
+	thread->waiting = false;
+	if (thread->timer.pending())
+		timers.cancel(&thread->timer);
+
+	if (handoff && thread->state != BLOCKED && !thread->synced && thread->worker == nullptr &&
+		!thread->queued && (nWorkers == 1 || idleWorkers <= wakesPending))
+		setRunNext(worker(), thread);
+	else
+		makeRunnable(thread, false);
+}
+
+/**
+ * Returns the thread queue stored in the wait queue of a synchronization object
+ * The public wait queue has the layout of a thread queue, so the library doesn't
+ * expose its internal types
+ * @param waiters the wait queue
+ * @return the thread queue
+ */
+static ThreadQueue* waitersOf(uthread_waitq* waiters)
+{
+	static_assert(sizeof(uthread_waitq) == sizeof(ThreadQueue) && alignof(uthread_waitq) == alignof(ThreadQueue),
+				  "uthread_waitq must have the layout of ThreadQueue");
+	return reinterpret_cast<ThreadQueue*>(waiters);
+}
+
+/**
+ * Makes the running thread wait at the end of a wait queue until wakeFirst wakes it up
+ * A terminated waiter is removed from the queue by retire
+ * Must be called inside a critical section
+ * @param waiters the wait queue
+ */
+void Scheduler::waitIn(ThreadQueue* waiters)
+{
+	Thread* thread = currentThread;
+	waiters->push_back(thread);
+
+	// wakeFirst removes the thread from the queue before waking it up
+	while (waiters->contains(thread))
+		suspend(-1);
+}
+
+/**
+ * Removes the first thread of a wait queue and wakes it up
+ * Must be called inside a critical section
+ * @param waiters the wait queue
+ * @param handoff true to run the thread next on the calling worker, ahead of the ready threads
+ * @return the woken up thread, nullptr if the queue is empty
+ */
+Thread* Scheduler::wakeFirst(ThreadQueue* waiters, bool handoff)
+{
+	Thread* thread = waiters->pop_front();
+	if (thread != nullptr)
+		wake(thread, handoff);
+	return thread;
+}
+
+/**
+ * Locks a mutex the fast path found locked, the running thread waits until it is handed
+ * the mutex
+ * The state of a contended mutex only changes inside critical sections, so a waiter
+ * can't miss the unlock that hands it the mutex
+ * Must be called inside a critical section
+ * @param mutex the mutex
+ */
+void Scheduler::lockMutex(uthread_mutex_t* mutex)
+{
+	for (;;)
+	{
+		int state = 0;
+		if (__atomic_compare_exchange_n(&mutex->state, &state, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+			return;
+
+		// mark the mutex contended so its unlock takes the slow path, unless the holder
+		// unlocked it meanwhile
+		if (state == 1 && !__atomic_compare_exchange_n(&mutex->state, &state, 2, false, __ATOMIC_RELAXED,
+													   __ATOMIC_RELAXED))
+			continue;
+
+		waitIn(waitersOf(&mutex->waiters));
+		return;
+	}
+}
+
+/**
+ * Unlocks a mutex the fast path couldn't unlock, the mutex is handed to its first waiter
+ * The mutex stays locked while it is handed, so a thread that didn't wait can't take it
+ * Must be called inside a critical section
+ * @param mutex the mutex
+ * @return 0 if successful, -1 if the mutex isn't locked
+ */
+int Scheduler::unlockMutex(uthread_mutex_t* mutex)
+{
+	int state = 1;
+	if (__atomic_compare_exchange_n(&mutex->state, &state, 0, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+		return 0;
+	if (state == 0)
+		return -1;
+
+	// contended, the waiters may have been terminated
+	ThreadQueue* waiters = waitersOf(&mutex->waiters);
+	Thread* next = waiters->pop_front();
+	if (next == nullptr)
+	{
+		__atomic_store_n(&mutex->state, 0, __ATOMIC_RELEASE);
+		return 0;
+	}
+
+	__atomic_store_n(&mutex->state, waiters->empty() ? 1 : 2, __ATOMIC_RELEASE);
+	wake(next, true);
+	return 0;
+}
+
+/**
+ * Unlocks a mutex and makes the running thread wait on a condition variable, the mutex
+ * is locked again once the thread is signaled
+ * Must be called inside a critical section
+ * @param cond the condition variable
+ * @param mutex the mutex, held by the running thread
+ * @return 0 if successful, -1 if the mutex isn't locked
+ */
+int Scheduler::waitCond(uthread_cond_t* cond, uthread_mutex_t* mutex)
+{
+	Thread* thread = currentThread;
+	ThreadQueue* waiters = waitersOf(&cond->waiters);
+
+	// a signaler that locks the mutex after it is unlocked sees the waiter
+	__atomic_store_n(&cond->contended, 1, __ATOMIC_SEQ_CST);
+	waiters->push_back(thread);
+	if (unlockMutex(mutex) == -1)
+	{
+		waiters->remove(thread);
+		return -1;
+	}
+
+	while (waiters->contains(thread))
+		suspend(-1);
+
+	lockMutex(mutex);
+	return 0;
+}
+
+/**
+ * Wakes up the threads waiting on a condition variable
+ * Must be called inside a critical section
+ * @param cond the condition variable
+ * @param all true to wake up all the waiting threads, false to wake up the first
+ */
+void Scheduler::signalCond(uthread_cond_t* cond, bool all)
+{
+	ThreadQueue* waiters = waitersOf(&cond->waiters);
+	while (wakeFirst(waiters, !all) != nullptr && all)
+		;
+
+	if (waiters->empty())
+		__atomic_store_n(&cond->contended, 0, __ATOMIC_RELAXED);
+}
+
+/**
+ * Takes a unit of a semaphore, the running thread waits until it is handed a unit if
+ * none is available
+ * Must be called inside a critical section
+ * @param sem the semaphore
+ */
+void Scheduler::waitSem(uthread_sem_t* sem)
+{
+	ThreadQueue* waiters = waitersOf(&sem->waiters);
+
+	// a post after the value is checked sees the waiter and takes its slow path
+	__atomic_store_n(&sem->contended, 1, __ATOMIC_SEQ_CST);
+	int value = __atomic_load_n(&sem->value, __ATOMIC_SEQ_CST);
+	while (value > 0)
+	{
+		if (__atomic_compare_exchange_n(&sem->value, &value, value - 1, false, __ATOMIC_ACQUIRE,
+										__ATOMIC_RELAXED))
+		{
+			if (waiters->empty())
+				__atomic_store_n(&sem->contended, 0, __ATOMIC_RELAXED);
+			return;
+		}
+	}
+
+	waitIn(waiters);
+}
+
+/**
+ * Hands a unit the fast path posted to the first waiter of a semaphore
+ * A thread that didn't wait may have taken the unit meanwhile, the waiter keeps waiting then
+ * Must be called inside a critical section
+ * @param sem the semaphore
+ */
+void Scheduler::postSem(uthread_sem_t* sem)
+{
+	ThreadQueue* waiters = waitersOf(&sem->waiters);
+	int value = __atomic_load_n(&sem->value, __ATOMIC_RELAXED);
+	while (!waiters->empty() && value > 0)
+	{
+		if (__atomic_compare_exchange_n(&sem->value, &value, value - 1, false, __ATOMIC_ACQUIRE,
+										__ATOMIC_RELAXED))
+			wakeFirst(waiters, true);
+	}
+
+	if (waiters->empty())
+		__atomic_store_n(&sem->contended, 0, __ATOMIC_RELAXED);
+}
+
+/**
+ * Marks the channel operation of a waiting thread complete and wakes it up
+ * @param peer the waiting thread, removed from its wait queue
+ */
+void Scheduler::completeChan(Thread* peer)
+{
+	peer->chanDone = true;
+	wake(peer, true);
+}
+
+/**
+ * Sends an element through a channel
+ * A waiting receiver gets the element directly, it never waits while elements are buffered
+ * Must be called inside a critical section
+ * @param chan the channel
+ * @param elem the element
+ * @param wait true to wait while the channel is full, false to fail
+ * @return 0 if sent, -1 with errno set to EPIPE if the channel is closed, or to EAGAIN
+ * if it is full and wait is false
+ */
+int Scheduler::sendChan(uthread_chan_t* chan, const void* elem, bool wait)
+{
+	if (chan->closed)
+	{
+		errno = EPIPE;
+		return -1;
+	}
+
+	Thread* receiver = waitersOf(&chan->receivers)->pop_front();
+	if (receiver != nullptr)
+	{
+		memcpy(receiver->chanElem, elem, chan->elem_size);
+		completeChan(receiver);
+		return 0;
+	}
+
+	if (chan->count < chan->capacity)
+	{
+		unsigned tail = (chan->head + chan->count) % chan->capacity;
+		memcpy(chan->buffer + tail * chan->elem_size, elem, chan->elem_size);
+		chan->count++;
+		return 0;
+	}
+
+	if (!wait)
+	{
+		errno = EAGAIN;
+		return -1;
+	}
+
+	// a receiver copies the element from the stack of the waiting thread
+	Thread* thread = currentThread;
+	thread->chanElem = const_cast<void*>(elem);
+	thread->chanDone = false;
+	waitIn(waitersOf(&chan->senders));
+
+	if (!thread->chanDone)
+	{
+		errno = EPIPE;
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * Receives an element from a channel
+ * The slot a receive frees is refilled with the element of the first waiting sender,
+ * so the senders keep their FIFO order
+ * Must be called inside a critical section
+ * @param chan the channel
+ * @param elem set to the element
+ * @param wait true to wait while the channel is empty, false to fail
+ * @return 0 if received, -1 with errno set to EPIPE if the channel is closed and empty,
+ * or to EAGAIN if it is empty and wait is false
+ */
+int Scheduler::recvChan(uthread_chan_t* chan, void* elem, bool wait)
+{
+	Thread* sender = waitersOf(&chan->senders)->pop_front();
+	if (chan->count > 0)
+	{
+		memcpy(elem, chan->buffer + chan->head * chan->elem_size, chan->elem_size);
+		if (sender != nullptr)
+		{
+			memcpy(chan->buffer + chan->head * chan->elem_size, sender->chanElem, chan->elem_size);
+			completeChan(sender);
+			chan->head = (chan->head + 1) % chan->capacity;
+		}
+		else
+		{
+			chan->head = (chan->head + 1) % chan->capacity;
+			chan->count--;
+		}
+		return 0;
+	}
+
+	// rendezvous with a sender of an unbuffered channel
+	if (sender != nullptr)
+	{
+		memcpy(elem, sender->chanElem, chan->elem_size);
+		completeChan(sender);
+		return 0;
+	}
+
+	if (chan->closed)
+	{
+		errno = EPIPE;
+		return -1;
+	}
+	if (!wait)
+	{
+		errno = EAGAIN;
+		return -1;
+	}
+
+	// a sender copies its element directly to the waiting thread
+	Thread* thread = currentThread;
+	thread->chanElem = elem;
+	thread->chanDone = false;
+	waitIn(waitersOf(&chan->receivers));
+
+	if (!thread->chanDone)
+	{
+		errno = EPIPE;
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * Closes a channel and wakes up the threads waiting on it, their operations fail
+ * Must be called inside a critical section
+ * @param chan the channel
+ * @return 0 if successful, -1 with errno set to EPIPE if the channel is closed already
+ */
+int Scheduler::closeChan(uthread_chan_t* chan)
+{
+	if (chan->closed)
+	{
+		errno = EPIPE;
+		return -1;
+	}
+
+	chan->closed = 1;
+	while (wakeFirst(waitersOf(&chan->senders)) != nullptr)
+		;
+	while (wakeFirst(waitersOf(&chan->receivers)) != nullptr)
+		;
+	return 0;
+}
+
+/**
+ * Returns true if threads wait on a channel
+ * Must be called inside a critical section
+ * @param chan the channel
+ */
+bool Scheduler::chanBusy(uthread_chan_t* chan)
+{
+	return !waitersOf(&chan->senders)->empty() || !waitersOf(&chan->receivers)->empty();
+}
+
+/**
+ * Sets the priority of the requested thread
+ * A ready thread is moved to the end of its new priority
+ * @param tid the thread id
+ * @param priority the new priority, 0 is the highest
+ * @return 0 if successful, otherwise -1
+ */
+int Scheduler::setPriority(int tid, int priority)
+{
+	if (!exists(tid) || priority < 0 || priority >= UTHREAD_PRIORITY_LEVELS)
+		return -1;
+
+	Thread* thread = threadArray[tid];
+	if (thread->queued && nWorkers == 1 && thread != workers[0].runNext)
+	{
+		readyList.setPriority(thread, priority);
+	}
+	else
+	{
+		thread->priority = priority;
+		thread->level = priority;
+	}
+
+	return 0;
+}
+
+/**
+ * Sets the quantum length of the requested thread
+ * The quantum of a running thread changes when its next quantum starts
+ * @param tid the thread id
+ * @param quantum_usecs the quantum length in microseconds, 0 for the scheduler quantum
+ * @return 0 if successful, otherwise -1
+ */
+int Scheduler::setQuantum(int tid, int quantum_usecs)
+{
+	if (!exists(tid) || quantum_usecs < 0)
+		return -1;
+
+	Thread* thread = threadArray[tid];
+	customQuanta += (quantum_usecs != 0) - (thread->quantum != 0);
+	thread->quantum = quantum_usecs;
+	return 0;
+}
+
+/**
+ * Blocks the running thread until the requested thread state changes to RUNNING
+ * @param tid thread id number
+ * @return 0 if successful, otherwise -1
+ */
+int Scheduler::sync(int tid)
+{
+	if (!exists(tid))
+		return -1;  // thread doesn't exist
+	Thread* running = currentThread;
+	if (running->id == MAIN_THREAD_ID)
+		return -1;  // main thread can't sync
+
+	// wait in the waiters queue of the requested thread
+	threadArray[tid]->syncWaiters.push_back(running);
+	running->synced = true;
+
+	switchThread(SCHED_SWITCH_SIG);
+
+	return 0;
+}
+
+/**
+ * Blocks the running thread until the requested joinable thread terminates
+ * The joiner waits in the joiners queue of the thread, and gets the result when the
+ * thread is retired. A thread that terminated before it was joined kept its id and
+ * result for the join
+ * Frees the id of the joined thread
+ * @param tid thread id number
+ * @param result set to the result of the thread, may be nullptr
+ * @return 0 if successful, otherwise -1
+ */
+int Scheduler::join(int tid, void** result)
+{
+	if (tid >= 0 && (size_t)tid < exits.size() && exits[tid].exited)
+	{
+		if (result != nullptr)
+			*result = exits[tid].result;
+		exits[tid].exited = false;
+		exits[tid].result = nullptr;
+		tids.release(tid);
+		return 0;
+	}
+
+	Thread* running = currentThread;
+	if (!exists(tid) || tid == running->id || !threadArray[tid]->joinable)
+		return -1;  // thread doesn't exist, isn't joinable or joins itself
+
+	// retire removes the joiner from the queue before waking it up
+	waitIn(&threadArray[tid]->joiners);
+
+	if (result != nullptr)
+		*result = running->joinResult;
+	running->joinResult = nullptr;
+	return 0;
+}
+
+/**
+ * Returns the terminated threads to the thread pool and frees the threads beyond its maximum
+ * Must not be called on the stack of a terminated thread, nor on a switch from the timer
+ * handler, where the interrupted thread may be inside the allocator
+ */
+void Scheduler::reap()
+{
+	Thread* zombie;
+	while ((zombie = zombies.pop_front()) != nullptr)
+		pool.release(zombie);
+	nZombies = 0;
+	pool.trim();
+}
+
+/**
+ * Reaps the terminated threads in the idle loop of a worker once enough of them piled up
+ * @param worker the idle worker
+ */
+void Scheduler::reapIdle(Worker* worker)
+{
+	if (nZombies >= REAP_BATCH && !worker->preempted)
+		reap();
+}
+
+/**
+ * Removes all blocks caused by a sync with the given thread
+ * @param thread the thread the woken threads are synced with
+ */
+void Scheduler::unsync(Thread* thread)
+{
+	Thread* waiter;
+	while ((waiter = thread->syncWaiters.pop_front()) != nullptr)
+	{
+		waiter->synced = false;
+
+		// add non blocked threads back to ready list
+		makeRunnable(waiter, false);
+	}
+}
+
+/**
+ * Makes a thread ready if it can run and isn't running or ready already
+ * @param thread the thread to make ready
+ * @param preempted true if the thread stopped running after using its whole quantum
+ */
+void Scheduler::makeRunnable(Thread* thread, bool preempted)
+{
+	if (thread->state != BLOCKED && !thread->synced && !thread->waiting && thread->worker == nullptr &&
+		!thread->queued)
+		makeReady(thread, preempted);
+}
+
+/**
+ * Takes the next thread to run from the ready threads
+ * In M:N mode takes from the run queue of the worker, or steals from the other workers
+ * @param w the worker that runs the thread
+ * @return the next thread, nullptr if there is no ready thread
+ */
+Thread* Scheduler::takeReady(Worker* w)
+{
+	// the thread handed off to first, a thread blocked while handed off to is dropped from it
+	Thread* next = w->runNext;
+	if (next != nullptr)
+	{
+		w->runNext = nullptr;
+		next = nWorkers == 1 ? next : claim(next);
+		if (next != nullptr)
+		{
+			next->queued = false;
+			return next;
+		}
+	}
+
+	if (nWorkers == 1)
+	{
+		// return only a non blocked thread
+		do {
+			next = readyList.pop();   // remove thread from ready list
+			if (next != nullptr)
+			{
+				next->queued = false;
+				nSpinning -= next->spinning;
+			}
+		} while (next != nullptr && next->state == BLOCKED);
+
+		return next;
+	}
+
+	while (steal(w, &next))
+	{
+		next = claim(next);
+		if (next != nullptr)
+			return next;
+	}
+
+	// the workers of the threads handed off to are busy running other threads
+	for (int i = 1; i < nWorkers; ++i)
+	{
+		Worker* other = &workers[(w->index + i) % nWorkers];
+		if (other->runNext != nullptr)
+		{
+			next = claim(other->runNext);
+			other->runNext = nullptr;
+			if (next != nullptr)
+				return next;
+		}
+	}
+	return nullptr;
+}
+
+/**
+ * Parks an idle worker until a thread may have become ready
+ * With a single worker waits in the poller, in M:N mode tries to steal a thread
+ * without the scheduler lock before sleeping
+ * Called with the scheduler lock held, returns with it held
+ * @param w the idle worker
+ * @return a stolen thread to run, nullptr if the worker was woken up
+ */
+Thread* Scheduler::park(Worker* w)
+{
+	// a wall-clock timer would interrupt the sleep of the worker every quantum
+	if (monotonic && w->slice != 0)
+		armTimer(w, 0);
+
+	// the queued entries must be in the kernel before the worker waits for their completions
+	if (ring.active() && ring.pending() != 0)
+		submitIo();
+
+	// round up to the millisecond resolution of epoll
+	long long timeout = idleTimeout();
+	int timeoutMs = timeout == -1 ? -1 : (int)((timeout + 999) / 1000);
+	struct epoll_event* events = w->events;
+
+	// a resume queued after the check wakes up the poller, so its wait returns right away
+	if (nWorkers == 1)
+	{
+		if (wakeupsQueued())
+			timeoutMs = 0;
+		dispatchEvents(events, poller.wait(timeoutMs, events));
+		return nullptr;
+	}
+
+	// one idle worker waits for the file descriptor events and the ring completions,
+	// the others sleep on the futex
+	if (!polling && (poller.watching() || ring.busy()))
+	{
+		polling = true;
+		schedLock.unlock();
+
+		int n = poller.wait(wakeupsQueued() ? 0 : timeoutMs, events);
+
+		schedLock.lock();
+		polling = false;
+		pollerWoken = false;
+		dispatchEvents(events, n);
+		return nullptr;
+	}
+
+	// a wake up after the sequence is read makes the futex wait return right away
+	idleWorkers++;
+	int sequence = wakeSequence.load(std::memory_order_seq_cst);
+	schedLock.unlock();
+
+	Thread* stolen = nullptr;
+	for (int i = 0; i < IDLE_STEAL_ATTEMPTS && !steal(w, &stolen); ++i)
+		sched_yield();
+	if (stolen == nullptr && !wakeupsQueued() && timeout != 0)
+	{
+		struct timespec ts;
+		ts.tv_sec = timeout / 1000000;
+		ts.tv_nsec = (long)(timeout % 1000000) * 1000;
+		syscall(SYS_futex, &wakeSequence, FUTEX_WAIT_PRIVATE, sequence, timeout == -1 ? nullptr : &ts,
+				nullptr, 0);
+	}
+
+	schedLock.lock();
+	idleWorkers--;
+	if (wakesPending > 0)
+		wakesPending--;
+
+	return stolen != nullptr ? claim(stolen) : nullptr;
+}
+
+/**
+ * Makes ready the threads whose wake up source fired, the queued asynchronous resumes,
+ * the passed deadlines, the completed ring operations and the file descriptor events
+ * Must be called inside a critical section, or by an idle worker
+ */
+void Scheduler::collectWakeups()
+{
+	if (!asyncResumes.empty())
+		drainAsyncResumes();
+	if (!offloads.finished.empty())
+		drainOffloads();
+	if (!timers.empty())
+		expireTimers();
+
+	if (ring.active())
+	{
+		// submit the entries of all the threads together at the end of the round, or once
+		// they waited a poll interval
+		if (ring.pending() != 0 && (submitDue() || clock() - lastSubmit >= POLL_INTERVAL_USECS))
+			submitIo();
+
+		// reaping takes no system call, calls that completed on submission are reaped too
+		completeIo();
+	}
+
+	// poll the file descriptors without waiting, at most once every poll interval
+	if (poller.watching())
+	{
+		long long now = clock();
+		if (now - lastPoll >= POLL_INTERVAL_USECS)
+		{
+			lastPoll = now;
+			struct epoll_event* events = currentWorker->events;
+			dispatchEvents(events, poller.wait(0, events));
+		}
+	}
+}
+
+/**
+ * Wakes up the threads whose deadline passed
+ */
+void Scheduler::expireTimers()
+{
+	Timer* timer = timers.expire(clock());
+	while (timer != nullptr)
+	{
+		Timer* next = timer->next;
+		timer->thread->timedOut = true;
+		// the thread can't be in its wait queue and in the ready threads at once
+		if (timer->thread->waitAddr != nullptr)
+			leaveWaitTable(timer->thread);
+		wake(timer->thread);
+		timer = next;
+	}
+}
+
+/**
+ * Wakes up the threads whose file descriptor events arrived
+ * @param events the events returned by the poller
+ * @param n the number of events
+ */
+void Scheduler::dispatchEvents(const struct epoll_event* events, int n)
+{
+	ThreadQueue ready;
+	poller.dispatch(events, n, &ready);
+
+	Thread* thread;
+	while ((thread = ready.pop_front()) != nullptr)
+		wake(thread);
+}
+
+/**
+ * Wakes up the threads whose ring operations completed
+ */
+void Scheduler::completeIo()
+{
+	Thread* thread;
+	while ((thread = ring.complete()) != nullptr)
+	{
+		// a thread terminated while its call was in flight is reaped once the kernel no
+		// longer uses its buffer
+		if (threadArray[thread->id] != thread)
+			bury(thread);
+		else
+			wake(thread);
+	}
+}
+
+/**
+ * Submits the queued ring entries
+ */
+void Scheduler::submitIo()
+{
+	lastSubmit = clock();
+	ring.submit();
+}
+
+/**
+ * Returns true if the queued ring entries shouldn't wait for more entries: no other
+ * thread is ready, or a ready thread likely runs a whole quantum first
+ * The entries are batched while the ready threads are I/O bound, a thread whose call
+ * waited behind a CPU bound thread would lose a whole round
+ * In M:N mode the entries are batched until the run queue of the worker is empty
+ */
+bool Scheduler::submitDue() const
+{
+	if (nWorkers == 1)
+		return nReady() == 0 || nSpinning > 0;
+	return worker()->runQueue.empty() && worker()->runNext == nullptr;
+}
+
+/**
+ * Returns the time an idle worker may sleep until the next deadline
+ * @return the time in microseconds, -1 if there is no deadline
+ */
+long long Scheduler::idleTimeout()
+{
+	if (timers.empty())
+		return -1;
+
+	long long timeout = timers.nextEvent() - clock();
+	return timeout > 0 ? timeout : 0;
+}
+
+/**
+ * Resumes the threads queued by resumeAsync
+ * Must be called inside a critical section, or by an idle worker
+ */
+void Scheduler::drainAsyncResumes()
+{
+	int tid;
+	while (asyncResumes.pop(&tid))
+		resume(tid);  // a thread that no longer exists is ignored
+}
+
+/**
+ * Wakes up the threads whose offloaded calls returned
+ * Must be called inside a critical section, or by an idle worker
+ */
+void Scheduler::drainOffloads()
+{
+	Thread* thread;
+	while (offloads.finished.pop(&thread))
+	{
+		thread->offloadFn = nullptr;
+		nOffloads--;
+
+		// a thread terminated while its call was running is reaped once the call returned
+		if (threadArray[thread->id] != thread)
+			bury(thread);
+		else
+			wake(thread);
+	}
+}
+
+/**
+ * Returns true if asynchronous resumes or returned offloaded calls wait to be collected
+ * Safe without the scheduler lock, the queues may be drained concurrently
+ */
+bool Scheduler::wakeupsQueued() const
+{
+	return !asyncResumes.empty() || !offloads.finished.empty();
+}
+
+/**
+ * Removes a terminated thread from the scheduler
+ * The thread is reaped later, since a thread that terminates itself still uses its stack
+ * @param thread the terminated thread
+ */
+void Scheduler::retire(Thread* thread)
+{
+	if (thread == currentThread)
+	{
+		currentThread = nullptr;
+		thread->worker = nullptr;
+	}
+
+	// remove from the ready list, from the waiters of its file descriptor or address, or
+	// from the wait queue it is in
+	if (thread->queued)
+		removeFromReadyList(thread->id);
+	else if (thread->fdEvents != 0)
+		poller.unwatch(thread);
+	else if (thread->waitAddr != nullptr)
+		leaveWaitTable(thread);
+	else if (thread->queue != nullptr)
+		thread->queue->remove(thread);
+
+	// a thread terminated on another worker left the thread table already, its id may
+	// belong to a new thread
+	if (!thread->terminating)
+		unregister(thread);
+
+	if (thread->timer.pending())
+		timers.cancel(&thread->timer);
+
+	// an offloaded call that didn't start running is dropped
+	if (thread->offloadFn != nullptr && offloads.cancel(thread))
+	{
+		thread->offloadFn = nullptr;
+		nOffloads--;
+	}
+
+	// reaped later, a thread that terminates itself is still using its stack, and a
+	// thread with a call in flight is reaped once the call completes or returns
+	if (thread->ioPending)
+		ring.cancel(thread);
+	else if (thread->offloadFn == nullptr)
+		bury(thread);
+}
+
+/**
+ * Removes a terminated thread from the thread table and frees its id
+ * Wakes up the threads synced with it or joining it
+ * @param thread the terminated thread
+ */
+void Scheduler::unregister(Thread* thread)
+{
+	// remove from thread array and free the thread id, a joinable thread that wasn't
+	// joined yet keeps its id and result for the join
+	threadArray[thread->id] = nullptr;
+	if (thread->joinable && thread->joiners.empty())
+	{
+		exits[thread->id].exited = true;
+		exits[thread->id].result = thread->result;
+	}
+	else
+	{
+		tids.release(thread->id);
+	}
+
+	// a single joiner runs next, like the waiter of a mutex
+	bool handoff = thread->joiners.front() != nullptr && thread->joiners.front()->next == nullptr;
+	Thread* joiner;
+	while ((joiner = thread->joiners.pop_front()) != nullptr)
+	{
+		joiner->joinResult = thread->result;
+		wake(joiner, handoff);
+	}
 
-	// if running thread wasn't terminated unsync threads
-	if (running != nullptr)
-		scheduler->unsync(running->id);
+	if (thread->quantum != 0)
+		customQuanta--;
 
-	// switch threads
-	Thread* next = nextThread();
-	Thread* prevThread = running;
-	if (prevThread != nullptr && prevThread->state != BLOCKED)
-		prevThread->state = READY;
-	scheduler->running = next;
-	scheduler->running->state = RUNNING;
+	// remove blocks on synced threads
+	unsync(thread);
+}
+
+/**
+ * Queues a terminated thread to be returned to the thread pool
+ * @param thread the terminated thread, not in any queue
+ */
+void Scheduler::bury(Thread* thread)
+{
+	zombies.push_back(thread);
+	nZombies++;
+}
+
+/**
+ * Block the timer based thread switch
+ * Enters a critical section, a timer tick that arrives inside it is deferred until it ends
+ * Critical sections may be nested
+ */
+void Scheduler::blockTimerThreadSwitch()
+{
+	// the thread doesn't migrate once its counter is raised
+	Thread* thread = currentThread;
+	thread->preemptDisabled = thread->preemptDisabled + 1;
+	std::atomic_signal_fence(std::memory_order_seq_cst);
+
+	if (thread->preemptDisabled == 1 && nWorkers > 1)
+	{
+		schedLock.lock();
+
+		// terminated by another worker while waiting for the lock, its id may belong to a
+		// new thread already, so it must not get back to the library call
+		if (thread->terminating)
+			switchThread(SCHED_SWITCH_SIG);
+	}
+}
+
+/**
+ * Unblock the timer based thread switch
+ * Leaves a critical section, and performs the thread switch of a tick that arrived inside it
+ */
+void Scheduler::unblockTimerThreadSwitch()
+{
+	// the thread may have migrated to another worker inside the critical section
+	Thread* thread = currentThread;
+	for (;;)
+	{
+		if (thread->preemptDisabled == 1 && nWorkers > 1)
+			schedLock.unlock();
+
+		std::atomic_signal_fence(std::memory_order_seq_cst);
+		thread->preemptDisabled = thread->preemptDisabled - 1;
+		std::atomic_signal_fence(std::memory_order_seq_cst);
+
+		if (thread->preemptDisabled != 0 || !thread->switchPending)
+			return;
+
+		// perform the deferred switch inside a critical section of its own
+		blockTimerThreadSwitch();
+		switchThread(SIGVTALRM);
+	}
+}
+
+
+//------------------------------------- Private Methods --------------------------------------------
+
+
+/**
+ * Initialize the quantum timer of the calling worker
+ * A single worker uses the process virtual timer, in M:N mode every worker has a timer
+ * that counts its own CPU time and signals its own kernel thread. Wall-clock quanta
+ * use a monotonic timer of every worker that signals its own kernel thread
+ */
+void Scheduler::initializeTimer()
+{
+	if (cooperative)
+		return;  // no timer and no signal handler
+
+	setTimerHandler(timerHandler);
+
+	Worker* w = worker();
+	if (nWorkers > 1 || monotonic)
+	{
+		struct sigevent event;
+		memset(&event, 0, sizeof(event));
+		event.sigev_notify = SIGEV_THREAD_ID;
+		event.sigev_signo = SIGVTALRM;
+		event.sigev_notify_thread_id = w->kernelTid;
+
+		if (timer_create(monotonic ? CLOCK_MONOTONIC : CLOCK_THREAD_CPUTIME_ID, &event, &w->timer))
+		{
+			std::cerr << SYS_ERR_HEADER << SYS_ERR_TIMER;
+			exit(1);
+		}
+	}
+
+	armTimer(w, quantum_usecs);
+}
+
+/**
+ * Programs the quantum timer of the calling worker for a time slice of the running thread
+ * While threads have quanta of their own every thread starts a full slice, otherwise
+ * the periodic timer is left running and no system call is made
+ * @param w the calling worker
+ * @param thread the thread that starts running
+ */
+void Scheduler::startSlice(Worker* w, const Thread* thread)
+{
+	if (cooperative)
+		return;
+
+	int slice = thread->quantum != 0 ? thread->quantum : quantum_usecs;
+	if (tickless)
+	{
+		// nothing to preempt the thread for, stop the timer until a thread becomes ready
+		// a waiting thread may become ready when its deadline passes or its I/O completes,
+		// keep ticking for it
+		if (nReady() == 0 && timers.empty() && !poller.watching() && !ring.busy() &&
+			nOffloads == 0)
+		{
+			stretch = 0;
+			if (w->slice != 0)
+				armTimer(w, 0);
+			return;
+		}
+
+		// stretch the quantum while few threads are ready, back to the quantum otherwise
+		if (maxQuantum > slice)
+		{
+			stretch = nReady() <= ADAPTIVE_SHORT_QUEUE ? stretch + 1 : 0;
+			for (int i = 0; i < stretch && slice < maxQuantum; ++i)
+				slice *= 2;
+			if (slice >= maxQuantum)
+			{
+				slice = maxQuantum;
+				stretch--;  // don't grow past the maximum
+			}
+		}
+
+		// end the slice when the next deadline passes, so the woken thread isn't delayed
+		if (!timers.empty())
+		{
+			long long until = idleTimeout();
+			if (until < slice)
+				slice = until > TIMER_WHEEL_TICK_USECS ? (int)until : TIMER_WHEEL_TICK_USECS;
+		}
+	}
+
+	if (customQuanta > 0 || slice != w->slice)
+		armTimer(w, slice);
+}
+
+/**
+ * Programs the quantum timer of the calling worker to expire every slice
+ * A single worker uses the process virtual timer, otherwise every worker has a timer
+ * that signals its own kernel thread
+ * @param w the calling worker
+ * @param usecs the time slice in microseconds
+ */
+void Scheduler::armTimer(Worker* w, int usecs)
+{
+	w->slice = usecs;
+
+	if (nWorkers == 1 && !monotonic)
+	{
+		struct itimerval timer;
+
+		// Configure the timer to expire after a slice
+		timer.it_value.tv_sec = usecs / 1000000;        // first time interval, seconds part
+		timer.it_value.tv_usec = usecs % 1000000;       // first time interval, microseconds part
+
+		// configure the timer to expire every slice after that.
+		timer.it_interval = timer.it_value;
+
+		// Start a virtual timer. It counts down whenever this process is executing.
+		if (setitimer(ITIMER_VIRTUAL, &timer, NULL)) {
+			std::cerr << SYS_ERR_HEADER << SYS_ERR_TIMER;
+			exit(1);
+		}
+		return;
+	}
+
+	struct itimerspec timer;
+	timer.it_value.tv_sec = usecs / 1000000;
+	timer.it_value.tv_nsec = (long)(usecs % 1000000) * 1000;
+	timer.it_interval = timer.it_value;
+
+	if (timer_settime(w->timer, 0, &timer, NULL))
+	{
+		std::cerr << SYS_ERR_HEADER << SYS_ERR_TIMER;
+		exit(1);
+	}
+}
+
+/**
+ * Removes the requested thread from the ready list
+ * @param tid the id of the thread to remove from the ready list
+ */
+void Scheduler::removeFromReadyList(int tid)
+{
+	// a thread in the run queue of a worker is dropped when it is taken
+	Thread* thread = threadArray[tid];
+	if (thread->queued && nWorkers == 1)
+	{
+		if (thread == workers[0].runNext)
+			workers[0].runNext = nullptr;
+		else
+			readyList.remove(thread);
+		thread->queued = false;
+		nSpinning -= thread->spinning;
+	}
+}
+
+/**
+ * Makes a thread run next on a worker, ahead of the ready threads
+ * The thread the worker was to run next goes to the end of the ready threads
+ * @param w the worker
+ * @param thread the thread, ready but not in the ready threads
+ */
+void Scheduler::setRunNext(Worker* w, Thread* thread)
+{
+	flushRunNext(w);
+	w->runNext = thread;
+	thread->queued = true;
+	thread->spinning = false;
+
+	// a second thread can run, start the stopped timer for the running thread
+	if (tickless && nWorkers == 1 && w->slice == 0 && currentThread != nullptr && thread != currentThread)
+		startSlice(w, currentThread);
+}
+
+/**
+ * Moves the thread a worker was to run next to the end of the ready threads
+ * In M:N mode a thread blocked or terminated meanwhile is dropped by the worker that takes it
+ * @param w the worker
+ */
+void Scheduler::flushRunNext(Worker* w)
+{
+	Thread* thread = w->runNext;
+	if (thread != nullptr)
+	{
+		w->runNext = nullptr;
+		makeReady(thread, false);
+	}
+}
+
+/**
+ * Returns the number of ready threads, including the thread handed off to (single worker mode)
+ */
+int Scheduler::nReady() const
+{
+	return readyList.size() + (workers[0].runNext != nullptr);
+}
+
+/**
+ * Adds a thread to the ready threads
+ * In M:N mode pushes to the run queue of the calling worker and wakes up an idle worker
+ * @param thread the thread to add
+ * @param preempted true if the thread stopped running after using its whole quantum
+ */
+void Scheduler::makeReady(Thread* thread, bool preempted)
+{
+	thread->queued = true;
+	thread->spinning = preempted;
+	if (nWorkers == 1)
+	{
+		nSpinning += preempted;
+		readyList.push(thread, preempted);
+
+		// a second thread can run, start the stopped timer for the running thread
+		if (tickless && workers[0].slice == 0 && currentThread != nullptr && thread != currentThread)
+			startSlice(&workers[0], currentThread);
+		return;
+	}
+
+	worker()->runQueue.push(thread);
+
+	// wake up a parked worker, unless enough of them are already waking up
+	if (idleWorkers > wakesPending)
+	{
+		wakesPending++;
+		wakeSequence.fetch_add(1, std::memory_order_relaxed);
+		syscall(SYS_futex, &wakeSequence, FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+	}
+	else if (polling && !pollerWoken)
+	{
+		pollerWoken = true;
+		poller.wake();
+	}
+}
+
+/**
+ * Makes room in the run queue of every worker for all the threads, so the timer
+ * handler pushes without allocating (M:N mode)
+ * Must be called inside a critical section, outside the timer handler
+ */
+void Scheduler::reserveRunQueues()
+{
+	if (nWorkers == 1)
+		return;
+
+	try {
+		for (int i = 0; i < nWorkers; ++i)
+			workers[i].runQueue.reserve(tids.capacity() + unclaimed);
+	} catch (std::bad_alloc& e) {
+		std::cerr << SYS_ERR_HEADER << SYS_ERR_MEM_ALLOC;
+		exit(1);
+	}
+}
+
+/**
+ * Accepts a thread taken from a run queue (M:N mode)
+ * Threads blocked or terminated while queued are dropped, the terminated are retired
+ * @param thread the taken thread
+ * @return the thread if it can run, otherwise nullptr
+ */
+Thread* Scheduler::claim(Thread* thread)
+{
+	thread->queued = false;
+	if (thread->terminating)
+	{
+		unclaimed--;
+		retire(thread);
+		return nullptr;
+	}
+	if (thread->state == BLOCKED || thread->synced)
+		return nullptr;
+
+	return thread;
+}
+
+/**
+ * Steals a thread from the run queues of the workers, starting after the given worker (M:N mode)
+ * Doesn't need the scheduler lock
+ * @param w the stealing worker
+ * @param thread set to the stolen thread
+ * @return true if a thread was stolen, otherwise false
+ */
+bool Scheduler::steal(Worker* w, Thread** thread)
+{
+	// the queue of the worker first, it is also taken from the top so threads run in FIFO order
+	for (int i = 0; i < nWorkers; ++i)
+	{
+		if (workers[(w->index + i) % nWorkers].runQueue.steal(thread))
+			return true;
+	}
+	return false;
+}
+
+/**
+ * Makes a thread running on another worker switch out
+ * The thread switches at the end of its current critical section, or at once when
+ * the worker is interrupted. Cooperative threads aren't interrupted, they switch at
+ * the end of their next library call
+ * @param thread the thread to switch out
+ */
+void Scheduler::kick(Thread* thread)
+{
+	thread->switchPending = 1;
+	if (!cooperative)
+		pthread_kill(thread->worker->pthread, SIGVTALRM);
+}
+
+/**
+ * Starts the kernel threads of workers 1 and up
+ */
+void Scheduler::startWorkers()
+{
+	for (int i = 1; i < nWorkers; ++i)
+	{
+		if (pthread_create(&workers[i].pthread, NULL, workerMain, &workers[i]))
+		{
+			std::cerr << SYS_ERR_HEADER << SYS_ERR_WORKER;
+			exit(1);
+		}
+	}
+}
+
+/**
+ * Free all the allocated memory and terminate the program with exit()
+ * While other kernel threads may use the scheduler the program ends with _exit()
+ * after flushing the output, and nothing is freed
+ * Called when main thread is terminated
+ */
+void Scheduler::end()
+{
+	// a tick must not reach the handler once the running thread is freed
+	setTimerHandler(SIG_IGN);
+	Thread* running = currentThread;
+	currentThread = nullptr;
+
+	// the other workers may be running threads or waiting in the poller, and pool threads
+	// may be running offloaded calls, so the scheduler and its threads must outlive them:
+	// exit() would run the static destructors under their feet
+	if (nWorkers > 1 || offloads.started())
+	{
+		fflush(nullptr);
+		_exit(0);
+	}
+
+	// free all allocated memory
+	// the stacks of the running threads are in use, they are released by the process exit
+	size_t i;
+	for (i = 1; i < threadArray.size(); ++i)
+	{
+		if (threadArray[i] != nullptr && threadArray[i]->worker == nullptr)
+			delete threadArray[i];
+	}
+	Thread* mainThread = threadArray[MAIN_THREAD_ID];
+	if (mainThread->worker == nullptr || mainThread == running)
+		delete mainThread;  // free main thread
+
+	// free the terminated and pooled threads
+	reap();
+	pool.configure(0, 0);
+	exit(0);
+}
+
+
+//------------------------------------- Static functions --------------------------------------------
+
+
+/**
+* Jump to the next ready thread in the scheduler ready list.
+* Switches to the idle loop of the worker when there is no ready thread
+* @param sig signal id
+*/
+static void switchThread(int sig)
+{
+	static Scheduler* scheduler = Scheduler::instance();
+
+	Worker* worker = scheduler->worker();
+	Thread* prevThread = currentThread;
+
+	// the woken threads run before the preempted thread, and a thread handed off to doesn't
+	// get the next quantum ahead of the ready threads, also when the tick arrived inside the
+	// critical section of a thread that switches out on its own
+	scheduler->collectWakeups();
+	if (sig == SIGVTALRM || (prevThread != nullptr && prevThread->switchPending))
+		scheduler->flushRunNext(worker);
+
+	if (prevThread != nullptr)
+	{
+		scheduler->readyList.stopped(prevThread);
+		prevThread->worker = nullptr;
+		if (prevThread->terminating)
+		{
+			// terminated by another worker while it was running
+			scheduler->retire(prevThread);
+			prevThread = nullptr;
+		}
+		else
+		{
+			// unsync threads and put it back in the ready list
+			if (prevThread->state != BLOCKED)
+				prevThread->state = READY;
+			scheduler->unsync(prevThread);
+			scheduler->makeRunnable(prevThread, sig == SIGVTALRM);
+		}
+	}
+
+	// the context of a terminated thread is saved in a scratch context that is never resumed
+	static Context terminated;
+	Context* prevContext = prevThread != nullptr ? &prevThread->context : &terminated;
+
+	// switch threads, the queued ring entries don't wait for a thread that likely runs a whole quantum
+	Thread* handoff = worker->runNext;
+	Thread* next = scheduler->takeReady(worker);
+	if (next != nullptr && next->spinning && scheduler->ring.active() && scheduler->ring.pending() != 0)
+		scheduler->submitIo();
+	if (next == nullptr)
+	{
+		currentThread = nullptr;
+		worker->preempted = sig == SIGVTALRM;
+		contextSwitch(prevContext, &worker->idleContext);
+	}
+	else
+	{
+		runThread(worker, prevContext, next, next == handoff);
+	}
+}
+
+/**
+ * Runs a thread on a worker
+ * Must be called inside a critical section
+ * @param w the worker that runs the thread
+ * @param from the context to save the current execution in
+ * @param thread the thread to run
+ * @param donated true if the thread gets the rest of the current quantum instead of a new slice
+ */
+static void runThread(Worker* w, Context* from, Thread* thread, bool donated)
+{
+	static Scheduler* scheduler = Scheduler::instance();
+
+	currentThread = thread;
+	thread->worker = w;
+	thread->state = RUNNING;
+	thread->switchPending = 0;
+	scheduler->readyList.started(thread);
+	if (!donated || w->slice == 0)
+		scheduler->startSlice(w, thread);  // a stopped timer has no quantum left to donate
 
 	// update quantum counters
-	scheduler->running->nQuantum++;
+	thread->nQuantum++;
 	scheduler->totalQuantums++;
 
-	if (prevThread != nullptr && sigsetjmp(prevThread->env, 1))
+	contextSwitch(from, &thread->context);
+}
+
+/**
+ * SIGVTALRM handler
+ * Switches threads, or defers the switch if the tick arrived inside a critical section
+ * @param sig signal id
+ */
+static void timerHandler(int sig)
+{
+	// an idle worker, or a worker between threads, has nothing to switch
+	Thread* running = currentThread;
+	if (running == nullptr)
+		return;
+
+	if (running->preemptDisabled)
+	{
+		running->switchPending = 1;
 		return;
+	}
 
-	scheduler->unblockTimerThreadSwitch();  // unblock timer signal
-	siglongjmp(scheduler->running->env, 1);
+	// the switch may make system calls, keep the errno of the interrupted thread
+	int savedErrno = errno;
+	Scheduler* scheduler = Scheduler::instance();
+	scheduler->blockTimerThreadSwitch();
+	switchThread(sig);
+	scheduler->unblockTimerThreadSwitch();
+	errno = savedErrno;
 }
 
 /**
- * Returns the next thread in the ready list
- * @return the next thread in the ready list, nullptr if list is empty
+ * Idle loop of a worker
+ * Runs the ready threads, and parks the worker when there are none
+ * In M:N mode runs with the scheduler lock held, like a thread that was switched to
+ * @param arg the worker
  */
-static Thread* nextThread()
+static void workerLoop(void* arg)
 {
-	static Scheduler* scheduler = Scheduler::instance();
-	if (scheduler->readyList.empty())
-		return nullptr;
+	Scheduler* scheduler = Scheduler::instance();
+	Worker* worker = static_cast<Worker*>(arg);
+
+	for (;;)
+	{
+		scheduler->reapIdle(worker);
+		scheduler->collectWakeups();
+
+		Thread* next = scheduler->takeReady(worker);
+		if (next == nullptr)
+			next = scheduler->park(worker);
+		if (next != nullptr)
+			runThread(worker, &worker->idleContext, next);
+	}
+}
+
+/**
+ * Entry point of the kernel thread of workers 1 and up
+ * @param arg the worker
+ * @return never returns
+ */
+static void* workerMain(void* arg)
+{
+	Scheduler* scheduler = Scheduler::instance();
+	Worker* worker = static_cast<Worker*>(arg);
+
+	currentWorker = worker;
+	worker->kernelTid = (pid_t)syscall(SYS_gettid);
+
+	scheduler->schedLock.lock();
+	scheduler->initializeTimer();
+	workerLoop(worker);
+	return nullptr;
+}
 
-	// return only a non numSyncedThreads thread
-	Thread *next;
-	do {
-		next = scheduler->readyList.front();
-		scheduler->readyList.pop_front();   // remove thread from ready list
-	} while (next->state == BLOCKED);
+/**
+ * Tells the scheduler an offloaded call returned, called by the offload pool threads
+ */
+static void offloadReturned()
+{
+	Scheduler::instance()->wakeIdle();
+}
+
+/**
+ * Sets the action taken on SIGVTALRM
+ * The handler switches stacks without returning, so the signal must not be masked
+ * while it runs, otherwise it stays masked in the thread that is switched to.
+ * A system call interrupted by a preemption is restarted when the thread runs again
+ * @param handler the signal handler
+ */
+static void setTimerHandler(void (*handler)(int))
+{
+	struct sigaction sa;
+	sa.sa_handler = handler;
+	sa.sa_flags = SA_NODEFER | SA_RESTART;
+	if (sigemptyset(&sa.sa_mask) == -1)
+	{
+		std::cerr << SYS_ERR_HEADER << SYS_ERR_SIG_INIT;
+		exit(1);
+	}
 
-	return next;
+	if (sigaction(SIGVTALRM, &sa, NULL) < 0)
+	{
+		std::cerr << SYS_ERR_HEADER << SYS_ERR_SIG_ACTION;
+		exit(1);
+	}
 }
@@ -1,9 +1,21 @@
 #ifndef UTHREADS_SCHEDULER_H
 #define UTHREADS_SCHEDULER_H
 
-#include <deque>
-#include "uthreads.h"   // for MAX_THREAD_NUM
+#include <atomic>
+#include <vector>
+#include "uthreads.h"
+#include "boundedqueue.h"
+#include "idallocator.h"
+#include "ioring.h"
+#include "offload.h"
+#include "poller.h"
+#include "readyqueue.h"
+#include "spinlock.h"
+#include "threadpool.h"
 #include "thread.h"
+#include "threadqueue.h"
+#include "timerwheel.h"
+#include "worker.h"
 
 
 /**
@@ -11,39 +23,195 @@
  */
 #define MAIN_THREAD_ID 0
 
+/**
+ * Maximal number of asynchronous resumes waiting for the scheduler, a power of 2
+ */
+#define ASYNC_RESUME_CAPACITY 1024
+
+/**
+ * Number of wait queues of the addresses threads wait on, a power of 2
+ */
+#define WAIT_TABLE_SIZE 256
+
+
+/**
+ * Wait queue of the threads waiting on the addresses that hash to it
+ */
+struct WaitBucket {
+
+	/**
+	 * The waiting threads, in the order they started waiting
+	 */
+	ThreadQueue waiters;
+
+	/**
+	 * The number of waiting threads, read by wakes outside critical sections
+	 */
+	int nWaiting = 0;
+};
+
 /**
  * Singleton class.
- * Round Robin thread scheduler.
+ * Thread scheduler, round robin unless another scheduling policy is selected.
+ * With a single worker all the threads run on the kernel thread that initialized the
+ * library. With several workers (M:N mode) the ready threads are spread over the run
+ * queues of the workers, idle workers steal from the others, and the scheduler state
+ * is guarded by a lock taken by the outermost critical section
  */
 struct Scheduler {
 
 	/**
 	 * Holds all the existing threads, cell index == tid
+	 * Grows on demand up to the thread limit
+	 */
+	std::vector<Thread*> threadArray;
+
+	/**
+	 * The exit status of a joinable thread that terminated before it was joined
+	 */
+	struct ExitStatus {
+
+		/**
+		 * True while the thread id is kept for the join
+		 */
+		bool exited = false;
+
+		/**
+		 * The result of the thread
+		 */
+		void* result = nullptr;
+	};
+
+	/**
+	 * The exit statuses of the terminated joinable threads, cell index == tid
+	 * Grows with the thread array
 	 */
-	Thread* threadArray[MAX_THREAD_NUM];
+	std::vector<ExitStatus> exits;
 
 	/**
-	 * Matrix of synced threads
-	 * blocking[1][4] != 0 -> thread 1 blocks thread 4
+	 * Allocator of free thread ids
 	 */
-	char syncMatrix[MAX_THREAD_NUM][MAX_THREAD_NUM];
+	IdAllocator tids;
 
 	/**
-	 * Holds the number of threads synced to a certain thread
-	 * blocked[4] = number of threads synced with thread 4
-	 * thread #4 can't run until all the synced thread ran
+	 * Pool of terminated threads reused by spawn
 	 */
-	int numSyncedThreads[MAX_THREAD_NUM];
+	ThreadPool pool;
 
 	/**
-	 * Queue of ready threads
+	 * The ready threads ordered by the scheduling policy (single worker mode)
 	 */
-	std::deque<Thread*> readyList;
+	ReadyQueue readyList;
 
 	/**
-	 * The current running thread
+	 * The workers running the threads, workers[0] is the kernel thread that initialized the library
 	 */
-	Thread* running;
+	Worker* workers = nullptr;
+
+	/**
+	 * The number of workers
+	 */
+	int nWorkers = 1;
+
+	/**
+	 * Guards the scheduler state in M:N mode
+	 * Held by the outermost critical section, and across thread switches
+	 */
+	SpinLock schedLock;
+
+	/**
+	 * The number of threads terminated while in a run queue that weren't taken from it yet,
+	 * they hold room in the run queues beyond the thread table (M:N mode)
+	 */
+	int unclaimed = 0;
+
+	/**
+	 * The number of workers parked in their idle loop (M:N mode)
+	 */
+	int idleWorkers = 0;
+
+	/**
+	 * The number of parked workers woken up that didn't leave their idle loop yet (M:N mode)
+	 */
+	int wakesPending = 0;
+
+	/**
+	 * Futex word parked workers sleep on, advanced by every wake up (M:N mode)
+	 */
+	std::atomic<int> wakeSequence{0};
+
+	/**
+	 * The I/O reactor, idle worker 0 sleeps in it until a resume source fires
+	 * In M:N mode a single idle worker at a time polls it while threads wait for events
+	 */
+	Poller poller;
+
+	/**
+	 * True while an idle worker waits in the poller (M:N mode)
+	 */
+	bool polling = false;
+
+	/**
+	 * True once the worker waiting in the poller was woken up for a ready thread (M:N mode)
+	 */
+	bool pollerWoken = false;
+
+	/**
+	 * The time the poller was last polled at a thread switch, in microseconds
+	 */
+	long long lastPoll = 0;
+
+	/**
+	 * The io_uring ring of the thread I/O calls, not set up with the epoll backend
+	 * Entries are submitted together at the end of a round of the ready threads, and
+	 * the completions are reaped when the scheduler takes the next thread
+	 */
+	IoRing ring;
+
+	/**
+	 * The time the ring entries were last submitted at a thread switch, in microseconds
+	 */
+	long long lastSubmit = 0;
+
+	/**
+	 * The kernel threads running the blocking calls threads offload
+	 */
+	OffloadPool offloads;
+
+	/**
+	 * The number of offloaded calls that weren't drained yet
+	 */
+	int nOffloads = 0;
+
+	/**
+	 * The ids of the threads resumed from signal handlers and other kernel threads
+	 * Drained by the scheduler when it takes the next thread to run
+	 */
+	BoundedQueue<int> asyncResumes{ASYNC_RESUME_CAPACITY};
+
+	/**
+	 * The wait queues of the addresses threads wait on, indexed by the hash of the address
+	 */
+	WaitBucket waitTable[WAIT_TABLE_SIZE];
+
+	/**
+	 * The deadlines of the waiting threads
+	 * Advanced when the scheduler takes the next thread, idle workers sleep until the next one
+	 */
+	TimerWheel timers;
+
+	/**
+	 * Terminated threads waiting to be returned to the thread pool
+	 * A thread that terminates itself is still running on its stack, and a switch from the
+	 * timer handler can't free memory, so threads are reaped by the next spawn, or in
+	 * batches by an idle worker
+	 */
+	ThreadQueue zombies;
+
+	/**
+	 * The number of threads in the zombies queue
+	 */
+	int nZombies = 0;
 
 	/**
 	 * Counter of the total number of quantums performed
@@ -63,19 +231,106 @@ struct Scheduler {
 	void setQuantumLength(int quantum_usecs);
 
 	/**
-	 * Add a thread to the scheduler thread list
+	 * Set the scheduling policy
+	 * Assumes the quantum length is already set
+	 * @param policy one of the UTHREAD_SCHED_ values
+	 */
+	void setPolicy(int policy);
+
+	/**
+	 * Set tickless scheduling with a single worker
+	 * @param tickless true for tickless scheduling
+	 * @param maxQuantum the maximal stretched quantum in microseconds, 0 for no stretching
+	 */
+	void setTickless(bool tickless, int maxQuantum);
+
+	/**
+	 * Set cooperative scheduling, without a quantum timer and a signal handler
+	 * @param cooperative true for cooperative scheduling
+	 */
+	void setCooperative(bool cooperative);
+
+	/**
+	 * Set the clock quanta are measured on
+	 * @param clock one of the UTHREAD_CLOCK_ values
+	 */
+	void setClock(int clock);
+
+	/**
+	 * Set the backend of the thread I/O calls
+	 * @param backend one of the UTHREAD_IO_ values
+	 */
+	void setIoBackend(int backend);
+
+	/**
+	 * Set the maximal number of kernel threads running offloaded calls
+	 * @param maxThreads the maximal number of offload threads
+	 */
+	void setOffloadThreads(int maxThreads);
+
+	/**
+	 * Set the maximal number of concurrent threads
+	 * @param maxThreads the maximal number of threads, 0 for no limit
+	 * @param initialThreads the number of thread table cells to allocate in advance
+	 */
+	void setThreadLimit(int maxThreads, int initialThreads);
+
+	/**
+	 * Set the number of workers, the calling kernel thread becomes worker 0
+	 * @param n the number of workers
+	 */
+	void setWorkers(int n);
+
+	/**
+	 * Starts scheduling with the main thread running on the calling kernel thread
+	 * Starts the quantum timer and the other workers
+	 * Takes ownership of the thread
+	 * @param mainThread the main thread
+	 */
+	void start(Thread* mainThread);
+
+	/**
+	 * Add a thread to the scheduler thread list and make it ready
 	 * Takes ownership of the thread
 	 * Assumes a valid thread is added
 	 * @param thread the thread to add to the scheduler thread list
-	 * @return 0 if successful, otherwise -1
 	 */
 	void add(Thread* thread);
 
 	/**
-	 * Returns a free thread ID
+	 * Returns the thread running on the calling worker, nullptr if the worker is idle
+	 */
+	Thread* current() const;
+
+	/**
+	 * Returns the calling worker
+	 */
+	Worker* worker() const;
+
+	/**
+	 * Returns the monotonic time in microseconds, the clock of the wait deadlines
+	 */
+	static long long clock();
+
+	/**
+	 * Reserves the lowest free thread ID
+	 * The ID is freed when the thread is terminated
 	 * @return thread id number, if no available id's returns -1
 	 */
-	int id() const;
+	int id();
+
+	/**
+	 * Frees a thread ID reserved by id() that no thread was created with
+	 * @param tid the thread id
+	 */
+	void releaseId(int tid);
+
+	/**
+	 * Check if a thread exists
+	 * @param tid thread id number
+	 * @return true if a thread with the given id exists, otherwise false
+	 */
+	bool exists(int tid) const;
 
 	/**
 	 * Returns the number of quantum of the requested thread
@@ -107,6 +362,245 @@ struct Scheduler {
 	 */
 	int resume(int tid);
 
+	/**
+	 * Queues the resume of a blocked thread, the scheduler resumes it when it takes the next thread
+	 * May be called from signal handlers and from kernel threads that don't run a thread
+	 * @param tid the thread to resume
+	 * @return 0 if queued, -1 if tid is negative or too many resumes are queued
+	 */
+	int resumeAsync(int tid);
+
+	/**
+	 * Wakes up the idle workers so they collect the wake ups queued from other kernel threads
+	 * May be called from signal handlers and from kernel threads that don't run a thread
+	 */
+	void wakeIdle();
+
+	/**
+	 * Moves the running thread to the end of the ready threads and switches threads
+	 */
+	void yield();
+
+	/**
+	 * Switches to the requested thread, the running thread goes to the end of the ready threads
+	 * @param tid the thread id
+	 * @return 0 if successful, -1 if the thread doesn't exist
+	 */
+	int yieldTo(int tid);
+
+	/**
+	 * Makes the running thread wait for at least the given time
+	 * @param usecs the time in microseconds
+	 * @return 0 if successful, -1 if the time is negative
+	 */
+	int sleep(int usecs);
+
+	/**
+	 * Makes the running thread wait until it is woken up, or until the deadline
+	 * Must be called inside a critical section
+	 * @param deadline the deadline on the clock() time line, -1 for no deadline
+	 * @return true if the deadline passed before the thread was woken up
+	 */
+	bool suspend(long long deadline);
+
+	/**
+	 * Makes the running thread wait until a file descriptor is ready, or until the timeout
+	 * Must be called inside a critical section
+	 * @param fd the file descriptor
+	 * @param events the UTHREAD_FD_ events to wait for
+	 * @param timeoutUsecs the timeout in microseconds, -1 for no timeout
+	 * @return the ready events, 0 if the timeout passed, -1 if fd can't be waited for
+	 */
+	int waitFd(int fd, int events, int timeoutUsecs);
+
+	/**
+	 * Makes an I/O call on the io_uring ring, the running thread waits for its completion
+	 * Must be called inside a critical section
+	 * @param opcode the IORING_OP_ operation
+	 * @param fd the file descriptor
+	 * @param addr the buffer, or the operation specific address
+	 * @param len the buffer length
+	 * @param offset the file offset, or the operation specific value
+	 * @param flags the operation specific flags
+	 * @param deadline the deadline on the clock() time line, -1 for no deadline
+	 * @param result set to the result of the call, -errno on failure, -ECANCELED if the
+	 * deadline passed
+	 * @return true if the call was made, false if the ring isn't set up or is full
+	 */
+	bool ringIo(int opcode, int fd, const void* addr, unsigned len, unsigned long long offset,
+				unsigned flags, long long deadline, int* result);
+
+	/**
+	 * Makes the running thread wait on an address if it holds the expected value, until
+	 * wakeAddress wakes it up or until the timeout
+	 * Must be called inside a critical section
+	 * @param addr the address
+	 * @param expected the value the address must hold
+	 * @param timeoutUsecs the timeout in microseconds, -1 for no timeout
+	 * @return 0 if woken up, -1 with errno set to EAGAIN if the value isn't expected, or
+	 * to ETIMEDOUT if the timeout passed
+	 */
+	int waitAddress(const int* addr, int expected, int timeoutUsecs);
+
+	/**
+	 * Wakes up the threads waiting on an address
+	 * Must be called inside a critical section
+	 * @param addr the address
+	 * @param n the maximal number of threads to wake up
+	 * @return the number of woken up threads
+	 */
+	int wakeAddress(const int* addr, int n);
+
+	/**
+	 * Returns the wait queue of an address
+	 * @param addr the address
+	 */
+	WaitBucket* waitBucket(const int* addr);
+
+	/**
+	 * Removes a thread from the wait queue of the address it waits on
+	 * Must be called inside a critical section
+	 * @param thread the thread, waits on an address
+	 */
+	void leaveWaitTable(Thread* thread);
+
+	/**
+	 * Runs a blocking call on a kernel thread of the offload pool, the running thread
+	 * waits until it returns
+	 * Must be called inside a critical section
+	 * @param fn the function to call
+	 * @param arg the argument of the function
+	 * @return the return value of the function, errno is set to the errno it left
+	 */
+	void* offload(void* (*fn)(void*), void* arg);
+
+	/**
+	 * Wakes up a waiting thread, it runs again unless it is blocked
+	 * Waking up a thread that isn't waiting has no effect
+	 * @param thread the thread to wake up
+	 * @param handoff true to run the thread next on the calling worker, ahead of the
+	 * ready threads
+	 */
+	void wake(Thread* thread, bool handoff = false);
+
+	/**
+	 * Makes the running thread wait at the end of a wait queue until wakeFirst wakes it up
+	 * Must be called inside a critical section
+	 * @param waiters the wait queue
+	 */
+	void waitIn(ThreadQueue* waiters);
+
+	/**
+	 * Removes the first thread of a wait queue and wakes it up
+	 * Must be called inside a critical section
+	 * @param waiters the wait queue
+	 * @param handoff true to run the thread next on the calling worker, ahead of the ready threads
+	 * @return the woken up thread, nullptr if the queue is empty
+	 */
+	Thread* wakeFirst(ThreadQueue* waiters, bool handoff = false);
+
+	/**
+	 * Locks a mutex the fast path found locked, the running thread waits until it is handed
+	 * the mutex
+	 * Must be called inside a critical section
+	 * @param mutex the mutex
+	 */
+	void lockMutex(uthread_mutex_t* mutex);
+
+	/**
+	 * Unlocks a mutex the fast path couldn't unlock, the mutex is handed to its first waiter
+	 * Must be called inside a critical section
+	 * @param mutex the mutex
+	 * @return 0 if successful, -1 if the mutex isn't locked
+	 */
+	int unlockMutex(uthread_mutex_t* mutex);
+
+	/**
+	 * Unlocks a mutex and makes the running thread wait on a condition variable, the mutex
+	 * is locked again once the thread is signaled
+	 * Must be called inside a critical section
+	 * @param cond the condition variable
+	 * @param mutex the mutex, held by the running thread
+	 * @return 0 if successful, -1 if the mutex isn't locked
+	 */
+	int waitCond(uthread_cond_t* cond, uthread_mutex_t* mutex);
+
+	/**
+	 * Wakes up the threads waiting on a condition variable
+	 * Must be called inside a critical section
+	 * @param cond the condition variable
+	 * @param all true to wake up all the waiting threads, false to wake up the first
+	 */
+	void signalCond(uthread_cond_t* cond, bool all);
+
+	/**
+	 * Takes a unit of a semaphore, the running thread waits until it is handed a unit if
+	 * none is available
+	 * Must be called inside a critical section
+	 * @param sem the semaphore
+	 */
+	void waitSem(uthread_sem_t* sem);
+
+	/**
+	 * Hands a unit the fast path posted to the first waiter of a semaphore
+	 * Must be called inside a critical section
+	 * @param sem the semaphore
+	 */
+	void postSem(uthread_sem_t* sem);
+
+	/**
+	 * Sends an element through a channel
+	 * Must be called inside a critical section
+	 * @param chan the channel
+	 * @param elem the element
+	 * @param wait true to wait while the channel is full, false to fail
+	 * @return 0 if sent, -1 with errno set to EPIPE if the channel is closed, or to EAGAIN
+	 * if it is full and wait is false
+	 */
+	int sendChan(uthread_chan_t* chan, const void* elem, bool wait);
+
+	/**
+	 * Receives an element from a channel
+	 * Must be called inside a critical section
+	 * @param chan the channel
+	 * @param elem set to the element
+	 * @param wait true to wait while the channel is empty, false to fail
+	 * @return 0 if received, -1 with errno set to EPIPE if the channel is closed and empty,
+	 * or to EAGAIN if it is empty and wait is false
+	 */
+	int recvChan(uthread_chan_t* chan, void* elem, bool wait);
+
+	/**
+	 * Closes a channel and wakes up the threads waiting on it
+	 * Must be called inside a critical section
+	 * @param chan the channel
+	 * @return 0 if successful, -1 with errno set to EPIPE if the channel is closed already
+	 */
+	int closeChan(uthread_chan_t* chan);
+
+	/**
+	 * Returns true if threads wait on a channel
+	 * Must be called inside a critical section
+	 * @param chan the channel
+	 */
+	bool chanBusy(uthread_chan_t* chan);
+
+	/**
+	 * Sets the priority of the requested thread
+	 * @param tid the thread id
+	 * @param priority the new priority, 0 is the highest
+	 * @return 0 if successful, otherwise -1
+	 */
+	int setPriority(int tid, int priority);
+
+	/**
+	 * Sets the quantum length of the requested thread
+	 * @param tid the thread id
+	 * @param quantum_usecs the quantum length in microseconds, 0 for the scheduler quantum
+	 * @return 0 if successful, otherwise -1
+	 */
+	int setQuantum(int tid, int quantum_usecs);
+
 	/**
 	 * Blocks the running thread until the requested thread state changes to RUNNING
 	 * @param tid thread id number
@@ -114,23 +608,180 @@ struct Scheduler {
 	 */
 	int sync(int tid);
 
+	/**
+	 * Blocks the running thread until the requested joinable thread terminates
+	 * Frees the id of the joined thread
+	 * @param tid thread id number
+	 * @param result set to the result of the thread, may be nullptr
+	 * @return 0 if successful, otherwise -1
+	 */
+	int join(int tid, void** result);
+
+	/**
+	 * Returns the terminated threads to the thread pool and frees the threads beyond its maximum
+	 * Must not be called on the stack of a terminated thread, nor on a switch from the timer
+	 * handler, where the interrupted thread may be inside the allocator
+	 */
+	void reap();
+
+	/**
+	 * Reaps the terminated threads in the idle loop of a worker once enough of them piled up
+	 * @param worker the idle worker
+	 */
+	void reapIdle(Worker* worker);
+
 	/**
 	 * Removes all blocks caused by a sync with the given thread
+	 * @param thread the thread the woken threads are synced with
 	 */
-	void unsync(int tid);
+	void unsync(Thread* thread);
+
+	/**
+	 * Makes a thread ready if it can run and isn't running or ready already
+	 * @param thread the thread to make ready
+	 * @param preempted true if the thread stopped running after using its whole quantum
+	 */
+	void makeRunnable(Thread* thread, bool preempted);
+
+	/**
+	 * Makes a thread run next on a worker, ahead of the ready threads
+	 * The thread the worker was to run next goes to the end of the ready threads
+	 * @param w the worker
+	 * @param thread the thread, ready but not in the ready threads
+	 */
+	void setRunNext(Worker* w, Thread* thread);
+
+	/**
+	 * Moves the thread a worker was to run next to the end of the ready threads
+	 * @param w the worker
+	 */
+	void flushRunNext(Worker* w);
+
+	/**
+	 * Returns the number of ready threads, including the thread handed off to (single worker mode)
+	 */
+	int nReady() const;
+
+	/**
+	 * Takes the next thread to run from the ready threads
+	 * In M:N mode takes from the run queue of the worker, or steals from the other workers
+	 * @param w the worker that runs the thread
+	 * @return the next thread, nullptr if there is no ready thread
+	 */
+	Thread* takeReady(Worker* w);
+
+	/**
+	 * Parks an idle worker until a thread may have become ready
+	 * With a single worker waits in the poller, in M:N mode tries to steal a thread
+	 * without the scheduler lock before sleeping
+	 * Called with the scheduler lock held, returns with it held
+	 * @param w the idle worker
+	 * @return a stolen thread to run, nullptr if the worker was woken up
+	 */
+	Thread* park(Worker* w);
+
+	/**
+	 * Makes ready the threads whose wake up source fired
+	 * Must be called inside a critical section, or by an idle worker
+	 */
+	void collectWakeups();
+
+	/**
+	 * Wakes up the threads whose deadline passed
+	 */
+	void expireTimers();
+
+	/**
+	 * Wakes up the threads whose file descriptor events arrived
+	 * @param events the events returned by the poller
+	 * @param n the number of events
+	 */
+	void dispatchEvents(const struct epoll_event* events, int n);
+
+	/**
+	 * Wakes up the threads whose ring operations completed
+	 */
+	void completeIo();
+
+	/**
+	 * Submits the queued ring entries
+	 */
+	void submitIo();
+
+	/**
+	 * Returns true if the queued ring entries shouldn't wait for more entries: no other
+	 * thread is ready, or a ready thread likely runs a whole quantum first
+	 */
+	bool submitDue() const;
+
+	/**
+	 * Returns the time an idle worker may sleep until the next deadline
+	 * @return the time in microseconds, -1 if there is no deadline
+	 */
+	long long idleTimeout();
+
+	/**
+	 * Resumes the threads queued by resumeAsync
+	 * Must be called inside a critical section, or by an idle worker
+	 */
+	void drainAsyncResumes();
+
+	/**
+	 * Wakes up the threads whose offloaded calls returned
+	 * Must be called inside a critical section, or by an idle worker
+	 */
+	void drainOffloads();
+
+	/**
+	 * Returns true if asynchronous resumes or returned offloaded calls wait to be collected
+	 * Safe without the scheduler lock, the queues may be drained concurrently
+	 */
+	bool wakeupsQueued() const;
+
+	/**
+	 * Removes a terminated thread from the scheduler
+	 * The thread is reaped later, since a thread that terminates itself still uses its stack
+	 * @param thread the terminated thread
+	 */
+	void retire(Thread* thread);
+
+	/**
+	 * Removes a terminated thread from the thread table and frees its id
+	 * Wakes up the threads synced with it or joining it
+	 * @param thread the terminated thread
+	 */
+	void unregister(Thread* thread);
+
+	/**
+	 * Queues a terminated thread to be returned to the thread pool
+	 * @param thread the terminated thread, not in any queue
+	 */
+	void bury(Thread* thread);
 
 	/**
 	 * Block the timer based thread switch
-	 * Use before critical code
+	 * Use before critical code, doesn't make a system call
 	 */
 	void blockTimerThreadSwitch();
 
 	/**
 	 * Unblock the timer based thread switch
-	 * Use after critical code is done
+	 * Use after critical code is done, performs a switch deferred by the critical code
 	 */
 	void unblockTimerThreadSwitch();
 
+	/**
+	 * Initialize the quantum timer of the calling worker
+	 */
+	void initializeTimer();
+
+	/**
+	 * Programs the quantum timer of the calling worker for a time slice of the running thread
+	 * @param w the calling worker
+	 * @param thread the thread that starts running
+	 */
+	void startSlice(Worker* w, const Thread* thread);
+
 private:
 
 	/**
@@ -139,9 +790,44 @@ private:
 	int quantum_usecs = 0;
 
 	/**
-	 * Initialized the quantum timer
+	 * True for cooperative scheduling, threads are never preempted
 	 */
-	void initializeTimer();
+	bool cooperative = false;
+
+	/**
+	 * The number of threads with a quantum of their own
+	 */
+	int customQuanta = 0;
+
+	/**
+	 * True if quanta are measured in wall-clock time, otherwise in CPU time
+	 */
+	bool monotonic = false;
+
+	/**
+	 * True if the thread I/O calls should use io_uring, the ring may still be unsupported
+	 */
+	bool uring = false;
+
+	/**
+	 * True for tickless scheduling, the timer is stopped while a single thread can run
+	 */
+	bool tickless = false;
+
+	/**
+	 * The maximal stretched quantum in microseconds, 0 for no stretching
+	 */
+	int maxQuantum = 0;
+
+	/**
+	 * The number of ready threads that used their whole last quantum (single worker mode)
+	 */
+	int nSpinning = 0;
+
+	/**
+	 * The number of consecutive quanta that started with few ready threads, each doubles the quantum
+	 */
+	int stretch = 0;
 
 	/**
 	 * Scheduler constructor
@@ -149,11 +835,17 @@ private:
 	Scheduler();
 
 	/**
-	 * Check if a thread is in the ready list
-	 * @param tid the thread to search in the ready list
-	 * @return true if in the ready list, otherwise false
+	 * Programs the quantum timer of the calling worker to expire every slice
+	 * @param w the calling worker
+	 * @param usecs the time slice in microseconds
 	 */
-	bool inReadyList(int tid) const;
+	void armTimer(Worker* w, int usecs);
+
+	/**
+	 * Marks the channel operation of a waiting thread complete and wakes it up
+	 * @param peer the waiting thread, removed from its wait queue
+	 */
+	void completeChan(Thread* peer);
 
 	/**
 	 * Remove the requested thread from the ready list
@@ -161,8 +853,53 @@ private:
 	 */
 	void removeFromReadyList(int tid);
 
+	/**
+	 * Adds a thread to the ready threads
+	 * In M:N mode pushes to the run queue of the calling worker and wakes up an idle worker
+	 * @param thread the thread to add
+	 * @param preempted true if the thread stopped running after using its whole quantum
+	 */
+	void makeReady(Thread* thread, bool preempted);
+
+	/**
+	 * Makes room in the run queue of every worker for all the threads, so the timer
+	 * handler pushes without allocating (M:N mode)
+	 * Must be called inside a critical section, outside the timer handler
+	 */
+	void reserveRunQueues();
+
+	/**
+	 * Accepts a thread taken from a run queue (M:N mode)
+	 * Threads blocked or terminated while queued are dropped, the terminated are retired
+	 * @param thread the taken thread
+	 * @return the thread if it can run, otherwise nullptr
+	 */
+	Thread* claim(Thread* thread);
+
+	/**
+	 * Steals a thread from the run queues of the workers, starting after the given worker (M:N mode)
+	 * Doesn't need the scheduler lock
+	 * @param w the stealing worker
+	 * @param thread set to the stolen thread
+	 * @return true if a thread was stolen, otherwise false
+	 */
+	bool steal(Worker* w, Thread** thread);
+
+	/**
+	 * Makes a thread running on another worker switch out
+	 * @param thread the thread to switch out
+	 */
+	void kick(Thread* thread);
+
+	/**
+	 * Starts the kernel threads of workers 1 and up
+	 */
+	void startWorkers();
+
 	/**
 	 * Free all the allocated memory and terminate the program with exit()
+	 * While other kernel threads may use the scheduler the program ends with _exit()
+	 * and nothing is freed
 	 */
 	void end();
 
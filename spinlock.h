@@ -0,0 +1,55 @@
+#ifndef UTHREADS_SPINLOCK_H
+#define UTHREADS_SPINLOCK_H
+
+#include <atomic>
+#include <sched.h>
+
+/**
+ * Number of failed attempts after which a waiting kernel thread yields the CPU
+ */
+#define SPIN_YIELD_LIMIT 128
+
+
+/**
+ * Test and test-and-set spin lock
+ * The lock isn't owned by a kernel thread, it may be released by a different
+ * kernel thread than the one that acquired it
+ */
+struct SpinLock {
+
+	/**
+	 * Acquires the lock
+	 */
+	void lock()
+	{
+		int spins = 0;
+		while (locked.exchange(true, std::memory_order_acquire))
+		{
+			while (locked.load(std::memory_order_relaxed))
+			{
+				if (++spins == SPIN_YIELD_LIMIT)
+				{
+					spins = 0;
+					sched_yield();  // the holder may have been descheduled
+				}
+			}
+		}
+	}
+
+	/**
+	 * Releases the lock
+	 */
+	void unlock()
+	{
+		locked.store(false, std::memory_order_release);
+	}
+
+private:
+
+	/**
+	 * True while the lock is held
+	 */
+	std::atomic<bool> locked{false};
+};
+
+#endif //UTHREADS_SPINLOCK_H
@@ -0,0 +1,69 @@
+#include <unistd.h>
+#include <sys/mman.h>
+#include "stack.h"
+
+#ifndef MAP_STACK
+#define MAP_STACK 0
+#endif
+
+
+/**
+ * Maps a stack
+ * @param size the requested stack size in bytes, rounded up to whole pages
+ * @return true if successful, otherwise false
+ */
+bool Stack::allocate(size_t size)
+{
+	size_t page = pageSize();
+	size = roundSize(size);
+
+	// reserve the stack and the guard page below it, pages are committed on first touch
+	void* mapping = mmap(nullptr, size + page, PROT_READ | PROT_WRITE,
+						 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+	if (mapping == MAP_FAILED)
+		return false;
+
+	if (mprotect(mapping, page, PROT_NONE) == -1)
+	{
+		munmap(mapping, size + page);
+		return false;
+	}
+
+	this->base = (char*)mapping + page;
+	this->size = size;
+	return true;
+}
+
+/**
+ * Unmaps the stack, if allocated
+ */
+void Stack::release()
+{
+	if (base == nullptr)
+		return;
+
+	size_t page = pageSize();
+	munmap(base - page, size + page);
+	base = nullptr;
+	size = 0;
+}
+
+/**
+ * Returns the size of a memory page
+ */
+size_t Stack::pageSize()
+{
+	static size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	return page;
+}
+
+/**
+ * Rounds a stack size up to whole pages
+ * @param size the stack size in bytes
+ * @return the size of the stack allocate() maps for the given size
+ */
+size_t Stack::roundSize(size_t size)
+{
+	size_t page = pageSize();
+	return (size + page - 1) & ~(page - 1);
+}
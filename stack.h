@@ -0,0 +1,50 @@
+#ifndef UTHREADS_STACK_H
+#define UTHREADS_STACK_H
+
+#include <stddef.h>
+
+
+/**
+ * A thread stack mapped with mmap
+ * The mapping starts with an inaccessible guard page, so a stack overflow faults
+ * instead of corrupting the memory below the stack. Pages are committed lazily
+ * by the kernel when they are first touched
+ */
+struct Stack {
+
+	/**
+	 * The lowest usable address of the stack, nullptr if not allocated
+	 */
+	char* base = nullptr;
+
+	/**
+	 * The usable size of the stack in bytes, a multiple of the page size
+	 */
+	size_t size = 0;
+
+	/**
+	 * Maps a stack
+	 * @param size the requested stack size in bytes, rounded up to whole pages
+	 * @return true if successful, otherwise false
+	 */
+	bool allocate(size_t size);
+
+	/**
+	 * Unmaps the stack, if allocated
+	 */
+	void release();
+
+	/**
+	 * Returns the size of a memory page
+	 */
+	static size_t pageSize();
+
+	/**
+	 * Rounds a stack size up to whole pages
+	 * @param size the stack size in bytes
+	 * @return the size of the stack allocate() maps for the given size
+	 */
+	static size_t roundSize(size_t size);
+};
+
+#endif //UTHREADS_STACK_H
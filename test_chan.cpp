@@ -0,0 +1,169 @@
+#include <errno.h>
+#include <stdint.h>
+#include "check.h"
+
+/**
+ * Checks of the channels: rendezvous without a buffer, FIFO order of a buffered
+ * channel, and close waking up the waiting threads. The threads are cooperative,
+ * so they run in the order the checks expect
+ */
+
+/**
+ * Capacity of the buffered channel
+ */
+#define CAPACITY 4
+
+
+static uthread_chan_t chan;
+static int received = 0;
+static int result = 0;
+static int error = 0;
+
+
+/**
+ * Receives an element into received
+ */
+static void* receive(void*)
+{
+	result = uthread_chan_recv(&chan, &received);
+	error = errno;
+	return nullptr;
+}
+
+/**
+ * Sends the element 7
+ */
+static void* send(void*)
+{
+	int value = 7;
+	result = uthread_chan_send(&chan, &value);
+	error = errno;
+	return nullptr;
+}
+
+/**
+ * Without a buffer a send waits for a receiver and the receiver gets the element
+ */
+static void checkRendezvous()
+{
+	int value = 5;
+	CHECK(uthread_chan_init(&chan, sizeof(int), 0) == 0);
+	errno = 0;
+	CHECK(uthread_chan_try_send(&chan, &value) == -1 && errno == EAGAIN);
+	CHECK(uthread_chan_try_recv(&chan, &value) == -1 && errno == EAGAIN);
+
+	int tid = uthread_spawn_arg(receive, nullptr);
+	uthread_yield();
+	CHECK(uthread_chan_send(&chan, &value) == 0);
+	CHECK(uthread_join(tid, nullptr) == 0);
+	CHECK(result == 0 && received == 5);
+
+	tid = uthread_spawn_arg(send, nullptr);
+	CHECK(uthread_chan_recv(&chan, &value) == 0 && value == 7);
+	CHECK(uthread_join(tid, nullptr) == 0);
+	CHECK(result == 0);
+	CHECK(uthread_chan_destroy(&chan) == 0);
+}
+
+/**
+ * A buffered channel keeps the FIFO order, also for a sender waiting on a full buffer
+ */
+static void checkBuffered()
+{
+	CHECK(uthread_chan_init(&chan, sizeof(int), CAPACITY) == 0);
+	for (int i = 0; i < CAPACITY; ++i)
+		CHECK(uthread_chan_try_send(&chan, &i) == 0);
+	int value = CAPACITY;
+	errno = 0;
+	CHECK(uthread_chan_try_send(&chan, &value) == -1 && errno == EAGAIN);
+
+	int tid = uthread_spawn_arg(send, nullptr);
+	uthread_yield();
+	for (int i = 0; i < CAPACITY; ++i)
+		CHECK(uthread_chan_recv(&chan, &value) == 0 && value == i);
+	CHECK(uthread_chan_try_recv(&chan, &value) == 0 && value == 7);
+	CHECK(uthread_join(tid, nullptr) == 0);
+	CHECK(result == 0);
+	CHECK(uthread_chan_destroy(&chan) == 0);
+}
+
+/**
+ * Close wakes up a waiting receiver, and the buffered elements are still received
+ */
+static void checkClose()
+{
+	CHECK(uthread_chan_init(&chan, sizeof(int), CAPACITY) == 0);
+	int tid = uthread_spawn_arg(receive, nullptr);
+	uthread_yield();
+	CHECK(uthread_chan_close(&chan) == 0);
+	CHECK(uthread_join(tid, nullptr) == 0);
+	CHECK(result == -1 && error == EPIPE);
+	CHECK(uthread_chan_destroy(&chan) == 0);
+
+	CHECK(uthread_chan_init(&chan, sizeof(int), CAPACITY) == 0);
+	int value = 3;
+	CHECK(uthread_chan_send(&chan, &value) == 0);
+	CHECK(uthread_chan_close(&chan) == 0);
+	errno = 0;
+	CHECK(uthread_chan_send(&chan, &value) == -1 && errno == EPIPE);
+	value = 0;
+	CHECK(uthread_chan_recv(&chan, &value) == 0 && value == 3);
+	errno = 0;
+	CHECK(uthread_chan_recv(&chan, &value) == -1 && errno == EPIPE);
+	CHECK(uthread_chan_destroy(&chan) == 0);
+
+	// a sender waiting for a receiver is woken up too
+	CHECK(uthread_chan_init(&chan, sizeof(int), 0) == 0);
+	tid = uthread_spawn_arg(send, nullptr);
+	uthread_yield();
+	CHECK(uthread_chan_close(&chan) == 0);
+	CHECK(uthread_join(tid, nullptr) == 0);
+	CHECK(result == -1 && error == EPIPE);
+	CHECK(uthread_chan_destroy(&chan) == 0);
+}
+
+/**
+ * The typed wrapper passes values of its type
+ */
+static void checkTyped()
+{
+	uthread_chan<long> typed(1);
+	long value = 0;
+	CHECK(typed.try_send(1L << 40) == 0);
+	CHECK(typed.try_send(1) == -1);
+	CHECK(typed.recv(&value) == 0 && value == 1L << 40);
+	CHECK(typed.close() == 0);
+	CHECK(typed.try_recv(&value) == -1 && errno == EPIPE);
+}
+
+/**
+ * A buffer too large for memory fails the creation, without ending the process
+ */
+static void checkTooLarge()
+{
+	errno = 0;
+	CHECK(uthread_chan_init(&chan, SIZE_MAX / 4, 2) == -1 && errno == ENOMEM);
+
+	struct Large {
+		char data[1 << 30];
+	};
+	uthread_chan<Large> typed(UINT32_MAX);
+	CHECK(!typed.valid());
+	CHECK(typed.try_recv(nullptr) == -1 && errno == EPIPE);
+}
+
+int main()
+{
+	uthread_options options;
+	uthread_options_init(&options);
+	options.cooperative = 1;
+	if (uthread_init_options(&options) != 0)
+		return 1;
+
+	checkRendezvous();
+	checkBuffered();
+	checkClose();
+	checkTyped();
+	checkTooLarge();
+	checkTerminate("test_chan");
+}
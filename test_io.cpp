@@ -0,0 +1,244 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <linux/filter.h>
+#include <linux/io_uring.h>
+#include <linux/seccomp.h>
+#include "check.h"
+
+/**
+ * Checks of the thread I/O calls and the offload pool: a pipe read blocks only the
+ * calling thread, uthread_wait_fd times out, regular files are read and written, and
+ * an offloaded call returns its value and errno. The checks run in a child process
+ * per I/O backend, since the library is initialized once: epoll, io_uring, and
+ * io_uring falling back to epoll when the kernel refuses to set up the ring
+ */
+
+/**
+ * Number of times the counting thread yields while another thread waits
+ */
+#define N_TICKS 100
+
+/**
+ * Timeout of the wait_fd check and the duration of the offloaded call, in microseconds
+ */
+#define WAIT_USECS 20000
+
+
+static int pipeFds[2];
+static volatile int ticks = 0;
+static volatile bool readDone = false;
+
+
+/**
+ * Returns the monotonic time in microseconds
+ */
+static long long now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+/**
+ * Reads a byte from the pipe
+ * @return the byte, -1 if the read failed
+ */
+static void* readPipe(void*)
+{
+	char c;
+	ssize_t n = uthread_read(pipeFds[0], &c, 1);
+	readDone = true;
+	return (void*)(intptr_t)(n == 1 ? c : -1);
+}
+
+/**
+ * Counts while yielding, so it only gets through if the other threads don't block the process
+ */
+static void* count(void*)
+{
+	for (int i = 0; i < N_TICKS; ++i)
+	{
+		ticks++;
+		uthread_yield();
+	}
+	return nullptr;
+}
+
+/**
+ * Sleeps on the kernel thread of the offload pool and fails with ENOENT
+ * @param arg returned as is
+ */
+static void* slowCall(void* arg)
+{
+	struct timespec wait = {0, WAIT_USECS * 1000L};
+	nanosleep(&wait, nullptr);
+	errno = ENOENT;
+	return arg;
+}
+
+/**
+ * A read of an empty pipe blocks only the reading thread, another thread keeps running
+ * @param flags the flags of the pipe, 0 for a pipe in blocking mode
+ */
+static void checkPipe(int flags)
+{
+	CHECK(pipe2(pipeFds, flags) == 0);
+	ticks = 0;
+	readDone = false;
+
+	int reader = uthread_spawn_arg(readPipe, nullptr);
+	int counter = uthread_spawn_arg(count, nullptr);
+	CHECK(uthread_join(counter, nullptr) == 0);
+	CHECK(ticks == N_TICKS && !readDone);
+
+	CHECK(write(pipeFds[1], "x", 1) == 1);
+	void* result = nullptr;
+	CHECK(uthread_join(reader, &result) == 0);
+	CHECK((intptr_t)result == 'x');
+
+	close(pipeFds[0]);
+	close(pipeFds[1]);
+}
+
+/**
+ * uthread_wait_fd returns 0 once its timeout passed, and the ready events after a write
+ */
+static void checkWaitFd()
+{
+	CHECK(pipe2(pipeFds, O_NONBLOCK) == 0);
+
+	long long start = now();
+	CHECK(uthread_wait_fd(pipeFds[0], UTHREAD_FD_READ, WAIT_USECS) == 0);
+	CHECK(now() - start >= WAIT_USECS);
+
+	CHECK(write(pipeFds[1], "x", 1) == 1);
+	CHECK(uthread_wait_fd(pipeFds[0], UTHREAD_FD_READ, -1) == UTHREAD_FD_READ);
+	CHECK(uthread_wait_fd(pipeFds[1], UTHREAD_FD_WRITE, -1) == UTHREAD_FD_WRITE);
+	CHECK(uthread_wait_fd(pipeFds[0], 0, 0) == -1);
+
+	close(pipeFds[0]);
+	close(pipeFds[1]);
+}
+
+/**
+ * Positioned writes and reads of a regular file
+ */
+static void checkFile()
+{
+	char path[] = "/tmp/test_io_XXXXXX";
+	int fd = mkstemp(path);
+	CHECK(fd != -1);
+	unlink(path);
+
+	const char data[] = "uthreads";
+	char back[sizeof(data)] = {0};
+	CHECK(uthread_pwrite(fd, data, sizeof(data), 4) == (ssize_t)sizeof(data));
+	CHECK(uthread_pread(fd, back, sizeof(back), 4) == (ssize_t)sizeof(back));
+	CHECK(memcmp(back, data, sizeof(data)) == 0);
+	CHECK(uthread_pread(fd, back, sizeof(back), 100) == 0);
+
+	close(fd);
+}
+
+/**
+ * An offloaded call returns its value and errno, and the other threads run meanwhile
+ */
+static void checkOffload()
+{
+	ticks = 0;
+	int counter = uthread_spawn_arg(count, nullptr);
+
+	errno = 0;
+	CHECK(uthread_offload(slowCall, (void*)42) == (void*)42);
+	CHECK(errno == ENOENT);
+	CHECK(ticks == N_TICKS);
+	CHECK(uthread_join(counter, nullptr) == 0);
+
+	CHECK(uthread_offload(nullptr, nullptr) == nullptr);
+}
+
+/**
+ * Returns true if the kernel sets up io_uring rings with the features the library needs
+ */
+static bool ioUringSupported()
+{
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	int fd = (int)syscall(__NR_io_uring_setup, 1, &params);
+	if (fd == -1)
+		return false;
+	close(fd);
+	unsigned needed = IORING_FEAT_NODROP | IORING_FEAT_RW_CUR_POS | IORING_FEAT_FAST_POLL;
+	return (params.features & needed) == needed;
+}
+
+/**
+ * Makes io_uring_setup fail with ENOSYS in the calling process, like an old kernel
+ */
+static void refuseIoUring()
+{
+	struct sock_filter filter[] = {
+		BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, nr)),
+		BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, __NR_io_uring_setup, 0, 1),
+		BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ERRNO | ENOSYS),
+		BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW),
+	};
+	struct sock_fprog program = {(unsigned short)(sizeof(filter) / sizeof(filter[0])), filter};
+	CHECK(prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) == 0);
+	CHECK(prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &program) == 0);
+	CHECK(syscall(__NR_io_uring_setup, 1, nullptr) == -1 && errno == ENOSYS);
+}
+
+/**
+ * Runs the checks with an I/O backend in a child process
+ * @param name the name of the checks
+ * @param backend one of the UTHREAD_IO_ values
+ * @param fallback true to refuse io_uring, so the library falls back to epoll
+ */
+static void checkBackend(const char* name, int backend, bool fallback)
+{
+	fflush(stdout);
+	pid_t child = fork();
+	if (child == 0)
+	{
+		checkFailures = 0;  // the parent counts the failed children
+		if (fallback)
+			refuseIoUring();
+		bool ring = backend == UTHREAD_IO_URING && ioUringSupported();
+
+		uthread_options options;
+		uthread_options_init(&options);
+		options.quantum_usecs = 1000;
+		options.io_backend = backend;
+		if (uthread_init_options(&options) != 0)
+			_exit(1);
+
+		checkPipe(O_NONBLOCK);
+		if (ring)
+			checkPipe(0);  // io_uring doesn't block the process on a blocking file descriptor
+		checkWaitFd();
+		checkFile();
+		checkOffload();
+		checkTerminate(name);
+	}
+
+	int status = 0;
+	CHECK(child != -1 && waitpid(child, &status, 0) == child);
+	CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+int main()
+{
+	checkBackend("test_io epoll", UTHREAD_IO_EPOLL, false);
+	checkBackend("test_io io_uring", UTHREAD_IO_URING, false);
+	checkBackend("test_io io_uring fallback", UTHREAD_IO_URING, true);
+	return checkResult("test_io");
+}
@@ -0,0 +1,143 @@
+#include <stdint.h>
+#include "check.h"
+
+/**
+ * Checks of joining threads: results of recursive joins, joins after the thread
+ * terminated, several joiners, and joins that fail
+ */
+
+/**
+ * Argument of the recursive check and its expected result
+ */
+#define FIB_N 12
+#define FIB_RESULT 144
+
+/**
+ * Number of joiners of the same thread
+ */
+#define N_JOINERS 3
+
+
+static int target;
+static int joined = 0;
+static int succeeded = 0;
+static intptr_t sum = 0;
+static void* lastResult = nullptr;
+
+
+/**
+ * Computes a Fibonacci number with a thread per call
+ * @param arg the index of the number
+ * @return the number
+ */
+static void* fib(void* arg)
+{
+	intptr_t n = (intptr_t)arg;
+	if (n < 2)
+		return (void*)n;
+	int t1 = uthread_spawn_arg(fib, (void*)(n - 1));
+	int t2 = uthread_spawn_arg(fib, (void*)(n - 2));
+	void* r1 = nullptr;
+	void* r2 = nullptr;
+	CHECK(t1 >= 0 && uthread_join(t1, &r1) == 0);
+	CHECK(t2 >= 0 && uthread_join(t2, &r2) == 0);
+	return (void*)((intptr_t)r1 + (intptr_t)r2);
+}
+
+/**
+ * Returns its argument
+ */
+static void* identity(void* arg)
+{
+	return arg;
+}
+
+/**
+ * Yields for a while and returns 7
+ */
+static void* slow(void*)
+{
+	for (int i = 0; i < 20; ++i)
+		uthread_yield();
+	return (void*)7;
+}
+
+/**
+ * Yields forever
+ */
+static void* forever(void*)
+{
+	for (;;)
+		uthread_yield();
+	return nullptr;
+}
+
+/**
+ * Joins the target and adds its result to the sum
+ */
+static void* joiner(void*)
+{
+	void* result = (void*)-1;
+	if (uthread_join(target, &result) == 0)
+	{
+		sum += (intptr_t)result;
+		succeeded++;
+		lastResult = result;
+	}
+	joined++;
+	return nullptr;
+}
+
+/**
+ * Nothing to do, not joinable
+ */
+static void plain()
+{
+}
+
+int main()
+{
+	uthread_options options;
+	uthread_options_init(&options);
+	options.quantum_usecs = 1000;
+	options.max_threads = 1000;
+	if (uthread_init_options(&options) != 0)
+		return 1;
+
+	// results through nested joins
+	void* result = nullptr;
+	int tid = uthread_spawn_arg(fib, (void*)FIB_N);
+	CHECK(uthread_join(tid, &result) == 0);
+	CHECK((intptr_t)result == FIB_RESULT);
+
+	// a thread that terminated keeps its result until it is joined, once
+	tid = uthread_spawn_arg(identity, (void*)42);
+	for (int i = 0; i < 10; ++i)
+		uthread_yield();
+	CHECK(uthread_join(tid, &result) == 0);
+	CHECK((intptr_t)result == 42);
+	CHECK(uthread_join(tid, &result) == -1);
+	CHECK(uthread_join(0, &result) == -1);
+	CHECK(uthread_join(uthread_spawn(plain), &result) == -1);
+
+	// all the joiners of a thread get its result
+	target = uthread_spawn_arg(slow, nullptr);
+	int joiners[N_JOINERS];
+	for (int i = 0; i < N_JOINERS; ++i)
+		joiners[i] = uthread_spawn_arg(joiner, nullptr);
+	for (int i = 0; i < N_JOINERS; ++i)
+		CHECK(uthread_join(joiners[i], nullptr) == 0);
+	CHECK(joined == N_JOINERS && succeeded == N_JOINERS && sum == 7 * N_JOINERS);
+
+	// terminating the thread wakes up its joiner, the join succeeds with a NULL result
+	target = uthread_spawn_arg(forever, nullptr);
+	int waiting = uthread_spawn_arg(joiner, nullptr);
+	for (int i = 0; i < 10; ++i)
+		uthread_yield();
+	CHECK(uthread_terminate(target) == 0);
+	CHECK(uthread_join(waiting, nullptr) == 0);
+	CHECK(joined == N_JOINERS + 1 && succeeded == N_JOINERS + 1);
+	CHECK(lastResult == nullptr && sum == 7 * N_JOINERS);
+
+	checkTerminate("test_join");
+}
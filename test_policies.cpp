@@ -0,0 +1,266 @@
+#include <new>
+#include <stdlib.h>
+#include <time.h>
+#include "readyqueue.h"
+#include "check.h"
+
+/**
+ * Checks of the orders of the scheduling policies, on the ready queue alone, and
+ * that the fair policy and the reaping of terminated threads never allocate or free
+ * memory in the timer handler
+ */
+
+/**
+ * Number of threads of every check
+ */
+#define N_THREADS 4
+
+/**
+ * Number of threads the allocation check spawns, in doubling steps
+ */
+#define N_SPINNERS 32
+
+/**
+ * Number of threads the reap check spawns in every round, and the number of rounds
+ */
+#define N_FINISHERS 16
+#define N_ROUNDS 8
+
+
+static volatile bool allocationExpected = true;
+static volatile int unexpectedAllocations = 0;
+
+
+/**
+ * Counts the allocations and frees made while the main thread only waits for quanta
+ * to pass, those are made in the timer handler
+ */
+void* operator new(size_t size)
+{
+	if (!allocationExpected)
+		unexpectedAllocations++;
+	void* memory = malloc(size != 0 ? size : 1);
+	if (memory == nullptr)
+		throw std::bad_alloc();
+	return memory;
+}
+
+void operator delete(void* memory) noexcept
+{
+	if (!allocationExpected && memory != nullptr)
+		unexpectedAllocations++;
+	free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+	if (!allocationExpected && memory != nullptr)
+		unexpectedAllocations++;
+	free(memory);
+}
+
+/**
+ * Pops all the threads of a ready queue and checks their order
+ * @param queue the ready queue
+ * @param order the expected thread ids
+ * @param n the number of threads
+ */
+static void checkOrder(ReadyQueue* queue, const int* order, int n)
+{
+	for (int i = 0; i < n; ++i)
+	{
+		Thread* thread = queue->pop();
+		CHECK(thread != nullptr && thread->id == order[i]);
+	}
+	CHECK(queue->pop() == nullptr);
+	CHECK(queue->size() == 0);
+}
+
+/**
+ * Strict priority: the highest priority first, FIFO within a priority
+ */
+static void checkPriority()
+{
+	ReadyQueue queue;
+	queue.setPolicy(UTHREAD_SCHED_PRIORITY, 1000);
+	Thread t1(1), t2(2), t3(3), t4(4);
+	t1.priority = 5;
+	t2.priority = 2;
+	t3.priority = 2;
+	t4.priority = UTHREAD_PRIORITY_LEVELS - 1;
+	queue.push(&t4, false);
+	queue.push(&t1, false);
+	queue.push(&t2, false);
+	queue.push(&t3, true);  // a preemption doesn't change the priority
+	const int order[N_THREADS] = {2, 3, 1, 4};
+	checkOrder(&queue, order, N_THREADS);
+
+	// a priority change moves a ready thread
+	queue.push(&t1, false);
+	queue.push(&t4, false);
+	queue.setPriority(&t4, 0);
+	const int changed[2] = {4, 1};
+	checkOrder(&queue, changed, 2);
+}
+
+/**
+ * Multi-level feedback queue: a preempted thread drops a level, a thread that gave up
+ * the CPU keeps it, and a boost moves all the threads back to their priority
+ */
+static void checkFeedback()
+{
+	ReadyQueue queue;
+	queue.setPolicy(UTHREAD_SCHED_MLFQ, 0);  // the minimal boost period
+	Thread t1(1), t2(2), t3(3), t4(4);
+	t3.priority = t3.level = UTHREAD_DEFAULT_PRIORITY + 1;
+
+	queue.push(&t1, true);   // drops to the level of t3, ahead of it
+	queue.push(&t2, false);
+	queue.push(&t3, false);
+	queue.push(&t4, true);
+	const int order[N_THREADS] = {2, 1, 3, 4};
+	checkOrder(&queue, order, N_THREADS);
+
+	// dropping again, down to the lowest level and not below
+	for (int i = 0; i < UTHREAD_PRIORITY_LEVELS + 2; ++i)
+	{
+		queue.push(&t1, true);
+		CHECK(queue.pop() == &t1);
+	}
+	CHECK(t1.level == UTHREAD_PRIORITY_LEVELS - 1);
+
+	// once the boost period passed t1 is back at its priority, ahead of t3
+	queue.push(&t3, false);
+	queue.push(&t1, false);
+	struct timespec wait = {0, MLFQ_BOOST_MIN_USECS * 2000};
+	nanosleep(&wait, nullptr);
+	const int boosted[2] = {1, 3};
+	checkOrder(&queue, boosted, 2);
+	CHECK(t1.level == t1.priority);
+}
+
+/**
+ * Fair: the lowest virtual runtime first, and threads that become ready start from the
+ * virtual runtime of the last thread that started running
+ */
+static void checkFair()
+{
+	ReadyQueue queue;
+	queue.setPolicy(UTHREAD_SCHED_FAIR, 1000);
+	Thread t1(1), t2(2), t3(3), t4(4);
+	t1.vruntime = 300;
+	t2.vruntime = 100;
+	t3.vruntime = 400;
+	t4.vruntime = 200;
+	queue.push(&t1, false);
+	queue.push(&t2, false);
+	queue.push(&t3, false);
+	queue.push(&t4, false);
+	queue.remove(&t1);
+	queue.push(&t1, false);
+	const int order[N_THREADS] = {2, 4, 1, 3};
+	checkOrder(&queue, order, N_THREADS);
+
+	// a thread that slept doesn't get ahead of the others by its old virtual runtime
+	queue.started(&t3);
+	t2.vruntime = 0;
+	queue.push(&t2, false);
+	CHECK(t2.vruntime == 400);
+	CHECK(queue.pop() == &t2);
+
+	// pushes within the reserved room don't allocate
+	Thread* threads[N_THREADS] = {&t1, &t2, &t3, &t4};
+	queue.reserve(N_THREADS);
+	allocationExpected = false;
+	for (int i = 0; i < N_THREADS; ++i)
+		queue.push(threads[i], false);
+	allocationExpected = true;
+	CHECK(unexpectedAllocations == 0);
+	while (queue.pop() != nullptr)
+	{
+	}
+}
+
+/**
+ * Spins forever
+ */
+static void spin()
+{
+	for (;;)
+	{
+	}
+}
+
+/**
+ * Returns at once
+ */
+static void finish()
+{
+}
+
+/**
+ * The timer handler pushes the preempted thread to the fair heap without allocating,
+ * also when the number of threads grows past the room of the heap
+ */
+static void checkFairHandler()
+{
+	uthread_options options;
+	uthread_options_init(&options);
+	options.quantum_usecs = 1000;
+	options.policy = UTHREAD_SCHED_FAIR;
+	options.initial_threads = 0;
+	options.max_threads = 0;
+	options.pool_max_threads = 0;  // every terminated thread is freed, see checkReapHandler
+	if (uthread_init_options(&options) != 0)
+	{
+		CHECK(!"uthread_init_options failed");
+		return;
+	}
+
+	for (int spawned = 0, step = 1; spawned < N_SPINNERS; spawned += step, step *= 2)
+	{
+		for (int i = 0; i < step; ++i)
+			CHECK(uthread_spawn(spin) > 0);
+
+		// every thread is preempted about twice
+		allocationExpected = false;
+		int quanta = uthread_get_total_quantums();
+		while (uthread_get_total_quantums() < quanta + 2 * (spawned + step + 1))
+		{
+		}
+		allocationExpected = true;
+	}
+	CHECK(unexpectedAllocations == 0);
+}
+
+/**
+ * The threads that terminate while the main thread waits for quanta are freed by the
+ * next spawn, not on the switches from the timer handler
+ * Runs after checkFairHandler, with a pool that keeps no threads
+ */
+static void checkReapHandler()
+{
+	for (int round = 0; round < N_ROUNDS; ++round)
+	{
+		for (int i = 0; i < N_FINISHERS; ++i)
+			CHECK(uthread_spawn(finish) > 0);
+
+		allocationExpected = false;
+		int quanta = uthread_get_total_quantums();
+		while (uthread_get_total_quantums() < quanta + N_SPINNERS + N_FINISHERS + 1)
+		{
+		}
+		allocationExpected = true;
+	}
+	CHECK(unexpectedAllocations == 0);
+}
+
+int main()
+{
+	checkPriority();
+	checkFeedback();
+	checkFair();
+	checkFairHandler();
+	checkReapHandler();
+	checkTerminate("test_policies");
+}
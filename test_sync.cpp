@@ -0,0 +1,157 @@
+#include <stdint.h>
+#include "check.h"
+
+/**
+ * Checks of the synchronization objects: mutexes, semaphores and condition
+ * variables hand off to their waiters in FIFO order. The threads are cooperative,
+ * so they run in the order the checks expect
+ */
+
+/**
+ * Number of waiting threads of every check
+ */
+#define N_WAITERS 4
+
+
+static uthread_mutex_t mutex = UTHREAD_MUTEX_INITIALIZER;
+static uthread_cond_t cond = UTHREAD_COND_INITIALIZER;
+static uthread_sem_t sem;
+static int order[N_WAITERS];
+static int done = 0;
+
+
+/**
+ * Records the index of a thread in the order the threads got through
+ * @param arg the index of the thread
+ */
+static void record(void* arg)
+{
+	order[done++] = (int)(intptr_t)arg;
+}
+
+/**
+ * Locks the mutex and records the order of the lockers
+ */
+static void* lockMutex(void* arg)
+{
+	uthread_mutex_lock(&mutex);
+	record(arg);
+	uthread_mutex_unlock(&mutex);
+	return nullptr;
+}
+
+/**
+ * Takes a unit of the semaphore and records the order of the takers
+ */
+static void* waitSem(void* arg)
+{
+	uthread_sem_wait(&sem);
+	record(arg);
+	return nullptr;
+}
+
+/**
+ * Waits on the condition variable and records the order of the waiters
+ */
+static void* waitCond(void* arg)
+{
+	uthread_mutex_lock(&mutex);
+	uthread_cond_wait(&cond, &mutex);
+	record(arg);
+	uthread_mutex_unlock(&mutex);
+	return nullptr;
+}
+
+/**
+ * Spawns the waiters and lets them all run until they wait
+ * @param f the function of the waiters
+ * @param tids the IDs of the waiters
+ */
+static void spawnWaiters(void* (*f)(void*), int* tids)
+{
+	done = 0;
+	for (intptr_t i = 0; i < N_WAITERS; ++i)
+		tids[i] = uthread_spawn_arg(f, (void*)i);
+	for (int i = 0; i < N_WAITERS; ++i)
+		uthread_yield();
+	CHECK(done == 0);
+}
+
+/**
+ * Joins the waiters and checks they got through in the order they waited
+ * @param tids the IDs of the waiters
+ */
+static void joinWaiters(const int* tids)
+{
+	for (int i = 0; i < N_WAITERS; ++i)
+		CHECK(uthread_join(tids[i], nullptr) == 0);
+	CHECK(done == N_WAITERS);
+	for (int i = 0; i < done; ++i)
+		CHECK(order[i] == i);
+}
+
+/**
+ * Unlock hands the mutex to the first waiter, so the unlocking thread can't take it back
+ */
+static void checkMutex()
+{
+	int tids[N_WAITERS];
+	CHECK(uthread_mutex_lock(&mutex) == 0);
+	spawnWaiters(lockMutex, tids);
+	CHECK(uthread_mutex_unlock(&mutex) == 0);
+	CHECK(uthread_mutex_trylock(&mutex) == -1);
+	joinWaiters(tids);
+	CHECK(uthread_mutex_trylock(&mutex) == 0);
+	CHECK(uthread_mutex_unlock(&mutex) == 0);
+}
+
+/**
+ * Post hands the unit to the first waiter. A woken thread may run before the threads
+ * woken earlier, so a unit is posted once the previous taker got through
+ */
+static void checkSem()
+{
+	int tids[N_WAITERS];
+	CHECK(uthread_sem_init(&sem, 0) == 0);
+	CHECK(uthread_sem_trywait(&sem) == -1);
+	spawnWaiters(waitSem, tids);
+	for (int i = 0; i < N_WAITERS; ++i)
+	{
+		CHECK(uthread_sem_post(&sem) == 0);
+		CHECK(uthread_sem_trywait(&sem) == -1);
+		while (done == i)
+			uthread_yield();
+	}
+	joinWaiters(tids);
+	CHECK(uthread_sem_post(&sem) == 0);
+	CHECK(uthread_sem_trywait(&sem) == 0);
+}
+
+/**
+ * Signal wakes up the thread that waits the longest, broadcast wakes up the rest
+ */
+static void checkCond()
+{
+	int tids[N_WAITERS];
+	spawnWaiters(waitCond, tids);
+	CHECK(uthread_cond_signal(&cond) == 0);
+	for (int i = 0; i < N_WAITERS; ++i)
+		uthread_yield();
+	CHECK(done == 1 && order[0] == 0);
+	CHECK(uthread_cond_broadcast(&cond) == 0);
+	joinWaiters(tids);
+}
+
+int main()
+{
+	uthread_options options;
+	uthread_options_init(&options);
+	options.cooperative = 1;
+	if (uthread_init_options(&options) != 0)
+		return 1;
+
+	checkMutex();
+	checkSem();
+	checkCond();
+	checkTerminate("test_sync");
+}
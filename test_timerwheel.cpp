@@ -0,0 +1,95 @@
+#include "timerwheel.h"
+#include "check.h"
+
+/**
+ * Checks of the timing wheel: timers expire in deadline order, within a tick of
+ * their deadline, on every level and past the last one, and cancelled timers don't
+ */
+
+/**
+ * Number of timers of the expiry check
+ */
+#define N_TIMERS 64
+
+
+/**
+ * Advances a wheel in steps and checks every timer expires in the step of its deadline
+ * @param wheel the wheel
+ * @param timers the timers added to the wheel
+ * @param deadlines the deadline of every timer
+ * @param n the number of timers
+ * @param now the current time, advanced to the last step
+ * @param step the time between steps in microseconds
+ * @param steps the number of steps
+ */
+static void expireSteps(TimerWheel* wheel, Timer* timers, const long long* deadlines, int n,
+						long long* now, long long step, int steps)
+{
+	for (int s = 0; s < steps; ++s)
+	{
+		*now += step;
+		for (Timer* timer = wheel->expire(*now); timer != nullptr; timer = timer->next)
+		{
+			int i = (int)(timer - timers);
+			CHECK(i >= 0 && i < n);
+			if (i < 0 || i >= n)
+				continue;
+			CHECK(!timer->pending());
+			CHECK(deadlines[i] <= *now);
+			CHECK(deadlines[i] > *now - step - TIMER_WHEEL_TICK_USECS);
+		}
+	}
+}
+
+int main()
+{
+	// deadlines growing geometrically, over every level of the wheel and past the last one
+	TimerWheel wheel;
+	Timer timers[N_TIMERS];
+	long long deadlines[N_TIMERS];
+	long long now = 1000000;
+	long long offset = 50;
+	for (int i = 0; i < N_TIMERS; ++i)
+	{
+		deadlines[i] = now + offset;
+		wheel.add(&timers[i], deadlines[i], now);
+		offset = offset * 3 / 2 + 7;
+	}
+	CHECK(!wheel.empty());
+	CHECK(wheel.nextEvent() < deadlines[0] + TIMER_WHEEL_TICK_USECS);
+
+	// cancelled timers never expire
+	wheel.cancel(&timers[1]);
+	wheel.cancel(&timers[N_TIMERS - 1]);
+	CHECK(!timers[1].pending());
+	deadlines[1] = -1;
+	deadlines[N_TIMERS - 1] = -1;
+
+	// fine steps over the first levels, then coarse steps for the far timers
+	expireSteps(&wheel, timers, deadlines, N_TIMERS, &now, TIMER_WHEEL_TICK_USECS, 100000);
+	long long far = 0;
+	for (int i = 0; i < N_TIMERS; ++i)
+		if (deadlines[i] > far)
+			far = deadlines[i];
+	expireSteps(&wheel, timers, deadlines, N_TIMERS, &now, (far - now) / 1000 + 1, 1001);
+	for (int i = 0; i < N_TIMERS; ++i)
+		CHECK(!timers[i].pending());
+	CHECK(wheel.empty());
+
+	// a timer whose deadline passed already expires at the next advance
+	Timer late;
+	wheel.add(&late, now - 500, now);
+	Timer* expired = wheel.expire(now);
+	CHECK(expired == &late && late.next == nullptr);
+
+	// a timer added after the wheel idled expires at its deadline, not at a skipped tick
+	now += 1000000000LL;
+	Timer idle;
+	wheel.add(&idle, now + 250, now);
+	CHECK(wheel.expire(now + 100) == nullptr);
+	expired = wheel.expire(now + 250 + TIMER_WHEEL_TICK_USECS);
+	CHECK(expired == &idle);
+	CHECK(wheel.empty());
+
+	return checkResult("test_timerwheel");
+}
@@ -0,0 +1,112 @@
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+#include "check.h"
+
+/**
+ * Checks of the address keyed wait and wake: a wait returns at once if the value
+ * changed, a wake wakes the requested number of waiters in FIFO order, and a wait
+ * times out. The threads are cooperative, so they run in the order the checks expect
+ */
+
+/**
+ * Number of waiting threads of the wake check
+ */
+#define N_WAITERS 4
+
+/**
+ * Timeout of the timeout check, in microseconds
+ */
+#define WAIT_USECS 10000
+
+
+static int word = 0;
+static int order[N_WAITERS];
+static int done = 0;
+
+
+/**
+ * Returns the monotonic time in microseconds
+ */
+static long long now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+/**
+ * Waits on the word while it holds 0 and records the order of the woken threads
+ * @param arg the index of the thread
+ */
+static void* waitWord(void* arg)
+{
+	CHECK(uthread_wait(&word, 0, -1) == 0);
+	order[done++] = (int)(intptr_t)arg;
+	return nullptr;
+}
+
+/**
+ * A wait on a value other than the expected one returns at once
+ */
+static void checkMismatch()
+{
+	word = 1;
+	errno = 0;
+	CHECK(uthread_wait(&word, 0, -1) == -1 && errno == EAGAIN);
+	word = 0;
+}
+
+/**
+ * A wake wakes up to the requested number of waiters, the first ones to wait
+ */
+static void checkWake()
+{
+	int tids[N_WAITERS];
+	done = 0;
+	for (intptr_t i = 0; i < N_WAITERS; ++i)
+		tids[i] = uthread_spawn_arg(waitWord, (void*)i);
+	for (int i = 0; i < N_WAITERS; ++i)
+		uthread_yield();
+	CHECK(done == 0);
+
+	CHECK(uthread_wake(&word, 2) == 2);
+	for (int i = 0; i < N_WAITERS; ++i)
+		uthread_yield();
+	CHECK(done == 2 && order[0] == 0 && order[1] == 1);
+
+	CHECK(uthread_wake(&word, N_WAITERS) == N_WAITERS - 2);
+	for (int i = 0; i < N_WAITERS; ++i)
+		CHECK(uthread_join(tids[i], nullptr) == 0);
+	CHECK(done == N_WAITERS && order[2] == 2 && order[3] == 3);
+
+	CHECK(uthread_wake(&word, 1) == 0);
+	CHECK(uthread_wake(&word, 0) == -1);
+	CHECK(uthread_wake(nullptr, 1) == -1);
+	CHECK(uthread_wait(nullptr, 0, -1) == -1);
+}
+
+/**
+ * A wait no thread wakes ends with ETIMEDOUT once its timeout passed
+ */
+static void checkTimeout()
+{
+	long long start = now();
+	errno = 0;
+	CHECK(uthread_wait(&word, 0, WAIT_USECS) == -1 && errno == ETIMEDOUT);
+	CHECK(now() - start >= WAIT_USECS);
+}
+
+int main()
+{
+	uthread_options options;
+	uthread_options_init(&options);
+	options.cooperative = 1;
+	if (uthread_init_options(&options) != 0)
+		return 1;
+
+	checkMismatch();
+	checkWake();
+	checkTimeout();
+	checkTerminate("test_wait");
+}
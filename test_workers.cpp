@@ -0,0 +1,217 @@
+#include <stdint.h>
+#include <time.h>
+#include <sys/syscall.h>
+#include "check.h"
+
+/**
+ * Checks of the M:N mode: threads are stolen by idle workers, a mutex excludes
+ * threads running on different workers, and a thread terminated while another
+ * worker runs it is gone when uthread_terminate returns. The process ends while the
+ * other workers are busy
+ */
+
+/**
+ * Number of workers and of spinning threads
+ */
+#define N_WORKERS 2
+#define N_THREADS 4
+
+/**
+ * Number of increments of the counter by every thread of the mutex check
+ */
+#define N_INCREMENTS 20000
+
+/**
+ * Number of rounds of the terminate check
+ */
+#define N_ROUNDS 50
+
+/**
+ * Seconds the stealing check waits for a thread to run on another worker
+ */
+#define STEAL_TIMEOUT_SECS 5
+
+
+static volatile int stop = 0;
+static volatile long kernelTids[N_THREADS];
+static volatile long spins = 0;
+static uthread_mutex_t mutex = UTHREAD_MUTEX_INITIALIZER;
+static volatile long counter = 0;
+
+
+/**
+ * Spins and records the kernel thread it runs on
+ * @param arg the index of the thread
+ */
+static void* recordWorker(void* arg)
+{
+	intptr_t i = (intptr_t)arg;
+	while (!stop)
+		kernelTids[i] = syscall(SYS_gettid);
+	return nullptr;
+}
+
+/**
+ * Increments the shared counter under the mutex, non atomically
+ */
+static void* increment(void*)
+{
+	for (int i = 0; i < N_INCREMENTS; ++i)
+	{
+		uthread_mutex_lock(&mutex);
+		long value = counter;
+		for (volatile int j = 0; j < 10; ++j)
+		{
+		}
+		counter = value + 1;
+		uthread_mutex_unlock(&mutex);
+	}
+	return nullptr;
+}
+
+/**
+ * Spins without ever giving up the CPU
+ */
+static void spinner()
+{
+	for (;;)
+		spins++;
+}
+
+/**
+ * Spins and yields
+ */
+static void yielder()
+{
+	for (;;)
+	{
+		spins++;
+		uthread_yield();
+	}
+}
+
+/**
+ * Terminates itself
+ */
+static void quit()
+{
+	uthread_terminate(uthread_get_tid());
+}
+
+/**
+ * @return the wall-clock time in seconds
+ */
+static long seconds()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec;
+}
+
+/**
+ * The spinning threads end up on more than one worker
+ */
+static void checkStealing()
+{
+	int tids[N_THREADS];
+	for (intptr_t i = 0; i < N_THREADS; ++i)
+		tids[i] = uthread_spawn_arg(recordWorker, (void*)i);
+
+	long deadline = seconds() + STEAL_TIMEOUT_SECS;
+	bool stolen = false;
+	while (!stolen && seconds() < deadline)
+	{
+		uthread_yield();
+		for (int i = 1; i < N_THREADS; ++i)
+			if (kernelTids[i] != 0 && kernelTids[0] != 0 && kernelTids[i] != kernelTids[0])
+				stolen = true;
+	}
+	CHECK(stolen);
+
+	stop = 1;
+	for (int i = 0; i < N_THREADS; ++i)
+		CHECK(uthread_join(tids[i], nullptr) == 0);
+}
+
+/**
+ * No increment under the mutex is lost
+ */
+static void checkMutex()
+{
+	int tids[N_THREADS];
+	for (int i = 0; i < N_THREADS; ++i)
+		tids[i] = uthread_spawn_arg(increment, nullptr);
+	for (int i = 0; i < N_THREADS; ++i)
+		CHECK(uthread_join(tids[i], nullptr) == 0);
+	CHECK(counter == (long)N_THREADS * N_INCREMENTS);
+}
+
+/**
+ * A terminated thread is gone at once, even when another worker runs it: its ID
+ * is invalid and the next spawn reuses it
+ */
+static void checkTerminated()
+{
+	for (int round = 0; round < N_ROUNDS; ++round)
+	{
+		int tid = uthread_spawn(round % 2 ? yielder : spinner);
+		int other = uthread_spawn(yielder);
+		long before = spins;
+		while (spins == before)
+			uthread_yield();
+
+		CHECK(uthread_terminate(tid) == 0);
+		CHECK(uthread_get_quantums(tid) == -1);
+		CHECK(uthread_spawn(quit) == tid);
+		CHECK(uthread_terminate(other) == 0);
+		for (int i = 0; i < 3; ++i)
+			uthread_yield();
+	}
+}
+
+/**
+ * Sleeps for a long time
+ */
+static void sleeper()
+{
+	uthread_sleep_usec(1000000);
+}
+
+/**
+ * Leaves the other workers busy running, yielding and sleeping threads, the process
+ * then ends while they run
+ */
+static void leaveBusy()
+{
+	for (int i = 0; i < N_THREADS; ++i)
+	{
+		CHECK(uthread_spawn(spinner) > 0);
+		CHECK(uthread_spawn(yielder) > 0);
+		CHECK(uthread_spawn(sleeper) > 0);
+	}
+	long before = spins;
+	while (spins < before + 1000)
+		uthread_yield();
+}
+
+int main()
+{
+	uthread_options options;
+	uthread_options_init(&options);
+	options.quantum_usecs = 1000;
+	options.workers = N_WORKERS;
+
+	// tickless needs a single worker
+	options.tickless = 1;
+	CHECK(uthread_init_options(&options) == -1);
+	options.tickless = 0;
+
+	if (uthread_init_options(&options) != 0)
+		return 1;
+
+	checkStealing();
+	checkMutex();
+	checkTerminated();
+	leaveBusy();
+	checkTerminate("test_workers");
+}
@@ -0,0 +1,85 @@
+#include <stdint.h>
+#include "check.h"
+
+/**
+ * Checks of the directed handoff: the target of uthread_yield_to runs ahead of the
+ * other ready threads, a missing target fails, and a blocked target isn't switched
+ * to. The threads are cooperative, so they run in the order the checks expect
+ */
+
+/**
+ * Number of ready threads of the handoff check
+ */
+#define N_THREADS 3
+
+
+static int order[N_THREADS + 1];
+static int done = 0;
+
+
+/**
+ * Records the index of the thread in the order the threads ran
+ * @param arg the index of the thread
+ */
+static void* record(void* arg)
+{
+	order[done++] = (int)(intptr_t)arg;
+	return nullptr;
+}
+
+/**
+ * The target runs next, and the other ready threads keep their order
+ */
+static void checkHandoff()
+{
+	int tids[N_THREADS];
+	done = 0;
+	for (intptr_t i = 0; i < N_THREADS; ++i)
+		tids[i] = uthread_spawn_arg(record, (void*)i);
+
+	CHECK(uthread_yield_to(tids[N_THREADS - 1]) == 0);
+	CHECK(done == N_THREADS);
+	CHECK(order[0] == N_THREADS - 1);
+	for (int i = 1; i < N_THREADS; ++i)
+		CHECK(order[i] == i - 1);
+
+	for (int i = 0; i < N_THREADS; ++i)
+		CHECK(uthread_join(tids[i], nullptr) == 0);
+}
+
+/**
+ * A missing target fails, and a blocked target acts like uthread_yield
+ */
+static void checkRejected()
+{
+	CHECK(uthread_yield_to(-1) == -1);
+	CHECK(uthread_yield_to(1000) == -1);
+
+	done = 0;
+	int blocked = uthread_spawn_arg(record, (void*)0);
+	int other = uthread_spawn_arg(record, (void*)1);
+	CHECK(uthread_block(blocked) == 0);
+	CHECK(uthread_yield_to(blocked) == 0);
+	CHECK(done == 1 && order[0] == 1);
+
+	CHECK(uthread_resume(blocked) == 0);
+	CHECK(uthread_join(blocked, nullptr) == 0);
+	CHECK(done == 2 && order[1] == 0);
+	CHECK(uthread_join(other, nullptr) == 0);
+
+	// the running thread switches to the next ready thread, or keeps running
+	CHECK(uthread_yield_to(uthread_get_tid()) == 0);
+}
+
+int main()
+{
+	uthread_options options;
+	uthread_options_init(&options);
+	options.cooperative = 1;
+	if (uthread_init_options(&options) != 0)
+		return 1;
+
+	checkHandoff();
+	checkRejected();
+	checkTerminate("test_yield_to");
+}
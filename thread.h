@@ -1,8 +1,14 @@
 #ifndef UTHREADS_THREAD_H
 #define UTHREADS_THREAD_H
 
-#include "uthreads.h"   // for STACK_SIZE
-#include <setjmp.h>
+#include <signal.h>   // for sig_atomic_t
+#include "uthreads.h"
+#include "context.h"
+#include "stack.h"
+#include "threadqueue.h"
+#include "timerwheel.h"
+
+struct Worker;
 
 
 /**
@@ -18,7 +24,7 @@ struct Thread {
 	/**
 	 * The thread id (tid)
 	 */
-	const int id;
+	int id;
 
 	/**
 	 * Quantum counter
@@ -26,38 +32,292 @@ struct Thread {
 	unsigned int nQuantum = 0;
 
 	/**
-	 * The saved thread environment
+	 * The saved thread execution context
 	 */
-	sigjmp_buf env;
+	Context context;
 
 	/**
-	 * Thread stack
+	 * Thread stack, not allocated for the main thread
 	 */
-	char stack[STACK_SIZE] = {};
+	Stack stack;
 
 	/**
 	 * The current state of the thread
 	 */
 	State state = READY;
 
+	/**
+	 * The previous thread in the queue the thread is in
+	 */
+	Thread* prev = nullptr;
+
+	/**
+	 * The next thread in the queue the thread is in
+	 */
+	Thread* next = nullptr;
+
+	/**
+	 * The queue the thread is in, nullptr if not queued
+	 */
+	ThreadQueue* queue = nullptr;
+
+	/**
+	 * True while the thread waits in the syncWaiters queue of another thread
+	 */
+	bool synced = false;
+
+	/**
+	 * The threads synced with this thread
+	 * They wait until this thread stops running
+	 */
+	ThreadQueue syncWaiters;
+
+	/**
+	 * True if the thread keeps its id after it terminates, until a thread joins it
+	 */
+	bool joinable = false;
+
+	/**
+	 * The value the thread function returned, nullptr if the thread was terminated
+	 */
+	void* result = nullptr;
+
+	/**
+	 * The threads joining this thread
+	 * They wait until this thread terminates
+	 */
+	ThreadQueue joiners;
+
+	/**
+	 * The result of the thread this thread joins, set when the joined thread terminates
+	 */
+	void* joinResult = nullptr;
+
+	/**
+	 * Nesting depth of the critical sections the thread is in
+	 * Timer based thread switches are deferred while it is not 0
+	 * A thread is always switched out inside a critical section, so a new thread starts at 1
+	 */
+	volatile sig_atomic_t preemptDisabled = 1;
+
+	/**
+	 * Set when a timer tick arrived while the thread was inside a critical section
+	 */
+	volatile sig_atomic_t switchPending = 0;
+
+	/**
+	 * The worker running the thread, nullptr if not running
+	 */
+	Worker* worker = nullptr;
+
+	/**
+	 * True while the thread is in the ready threads
+	 * In M:N mode a thread blocked while in a run queue stays there until a worker takes it
+	 */
+	bool queued = false;
+
+	/**
+	 * Set when the thread was terminated while running on another worker or while in
+	 * a run queue (M:N mode). The thread left the thread table and its id was freed, it
+	 * is retired by the worker that switches it out or takes it next
+	 */
+	bool terminating = false;
+
+	/**
+	 * The thread priority, 0 is the highest
+	 * The priority policy runs threads by it, the multi-level feedback queue starts and
+	 * boosts threads to it
+	 */
+	int priority = UTHREAD_DEFAULT_PRIORITY;
+
+	/**
+	 * The current level of the thread in the multi-level feedback queue
+	 */
+	int level = UTHREAD_DEFAULT_PRIORITY;
+
+	/**
+	 * The multi-level feedback queue boost period the level of the thread was set in
+	 */
+	unsigned int levelEpoch = 0;
+
+	/**
+	 * The quantum length of the thread in microseconds, 0 for the scheduler quantum
+	 * The fair policy also uses it as the weight of the thread
+	 */
+	int quantum = 0;
+
+	/**
+	 * The weighted CPU time the thread ran in nanoseconds, used by the fair policy
+	 */
+	long long vruntime = 0;
+
+	/**
+	 * The CPU time of the worker when the thread last started running in nanoseconds,
+	 * used by the fair policy
+	 */
+	long long runStart = 0;
+
+	/**
+	 * Index of the thread in the fair policy heap, -1 if not in the heap
+	 */
+	int heapIndex = -1;
+
+	/**
+	 * True while the thread waits for a library event, like the end of a sleep
+	 * The thread can't run until it is woken up, even if it is resumed
+	 */
+	bool waiting = false;
+
+	/**
+	 * Set when the deadline of the wait of the thread passed before it was woken up
+	 */
+	bool timedOut = false;
+
+	/**
+	 * The timer of the deadline of the wait of the thread
+	 */
+	Timer timer;
+
+	/**
+	 * The UTHREAD_FD_ events the thread waits for on a file descriptor, 0 if it doesn't
+	 */
+	int fdEvents = 0;
+
+	/**
+	 * The UTHREAD_FD_ events that ended the file descriptor wait of the thread
+	 */
+	int readyEvents = 0;
+
+	/**
+	 * True if the thread used its whole last quantum, it likely runs a whole quantum again
+	 */
+	bool spinning = false;
+
+	/**
+	 * True while an io_uring operation of the thread is in flight
+	 */
+	bool ioPending = false;
+
+	/**
+	 * The result of the last io_uring operation of the thread, -errno on failure
+	 */
+	int ioResult = 0;
+
+	/**
+	 * The address the thread waits on with uthread_wait, nullptr if it doesn't
+	 */
+	const int* waitAddr = nullptr;
+
+	/**
+	 * The offloaded call of the thread, nullptr if the thread has none
+	 */
+	void* (*offloadFn)(void*) = nullptr;
+
+	/**
+	 * The argument of the offloaded call
+	 */
+	void* offloadArg = nullptr;
+
+	/**
+	 * The return value of the offloaded call
+	 */
+	void* offloadResult = nullptr;
+
+	/**
+	 * The errno the offloaded call left
+	 */
+	int offloadErrno = 0;
+
+	/**
+	 * The element a thread waiting on a channel sends, or receives into
+	 */
+	void* chanElem = nullptr;
+
+	/**
+	 * Set by the peer that completed the channel operation of a waiting thread, left
+	 * false if the channel was closed
+	 */
+	bool chanDone = false;
+
 	/**
 	 * Thread constructor
 	 * @param _id the thread id
 	 * @param f the function the thread wraps
+	 * @param _arg the argument of the function
 	 */
-	Thread(int _id, void (*f)(void) = nullptr) : id(_id), func(f) {}
+	Thread(int _id, void* (*f)(void*) = nullptr, void* _arg = nullptr) : id(_id), func(f), arg(_arg)
+	{
+		timer.thread = this;
+	}
+
+	/**
+	 * Reinitializes a recycled thread, the stack is kept
+	 * Assumes the thread isn't in any queue
+	 * @param _id the thread id
+	 * @param f the function the thread wraps
+	 * @param _arg the argument of the function
+	 */
+	void reset(int _id, void* (*f)(void*), void* _arg)
+	{
+		id = _id;
+		func = f;
+		arg = _arg;
+		nQuantum = 0;
+		state = READY;
+		synced = false;
+		joinable = false;
+		result = nullptr;
+		joinResult = nullptr;
+		preemptDisabled = 1;
+		switchPending = 0;
+		worker = nullptr;
+		queued = false;
+		terminating = false;
+		priority = UTHREAD_DEFAULT_PRIORITY;
+		level = UTHREAD_DEFAULT_PRIORITY;
+		levelEpoch = 0;
+		quantum = 0;
+		vruntime = 0;
+		runStart = 0;
+		heapIndex = -1;
+		waiting = false;
+		timedOut = false;
+		fdEvents = 0;
+		readyEvents = 0;
+		spinning = false;
+		ioPending = false;
+		ioResult = 0;
+		waitAddr = nullptr;
+		offloadFn = nullptr;
+		offloadArg = nullptr;
+		offloadResult = nullptr;
+		offloadErrno = 0;
+		chanElem = nullptr;
+		chanDone = false;
+	}
 
 	/**
 	 * Thread Destructor
+	 * Releases the thread stack
+	 */
+	~Thread() { stack.release(); }
+
+	/**
+	 * Runs the function the thread wraps and keeps its return value
 	 */
-	~Thread() {}
+	void run() { result = func(arg); }
 
 private:
 
 	/**
 	 * pointer to the function the thread wraps
 	 */
-	void (*func)(void);
+	void* (*func)(void*);
+
+	/**
+	 * The argument of the function the thread wraps
+	 */
+	void* arg;
 };
 
 #endif //UTHREADS_THREAD_H
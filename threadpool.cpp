@@ -0,0 +1,159 @@
+#include <iostream>
+#include <stdlib.h> // for exit()
+#include "threadpool.h"
+#include "uthreads.h"   // for STACK_SIZE
+#include "messages.h"
+
+
+//---------------------------------------- Public Methods -------------------------------------------------
+
+
+/**
+ * Returns a thread with a stack of the given size, reused from the pool if possible
+ * Terminates the process if the thread can't be allocated
+ * @param id the thread id
+ * @param f the function the thread wraps
+ * @param arg the argument of the function
+ * @param stackSize the stack size in bytes
+ * @return the thread, nullptr if the stack can't be mapped
+ */
+Thread* ThreadPool::acquire(int id, void* (*f)(void*), void* arg, size_t stackSize)
+{
+	trim();
+
+	// the bucket is added here, so releasing the thread later doesn't allocate
+	Bucket* b = bucket(Stack::roundSize(stackSize), true);
+	if (b == nullptr || b->threads.empty())
+		return allocate(id, f, arg, stackSize);
+
+	Thread* thread = b->threads.pop_front();
+	pooled--;
+	thread->reset(id, f, arg);
+	return thread;
+}
+
+/**
+ * Returns a thread to the pool, or keeps it to be freed by the next trim if the pool is full
+ * Doesn't allocate or free memory
+ * Assumes the thread isn't in any queue
+ * @param thread the thread to release
+ */
+void ThreadPool::release(Thread* thread)
+{
+	Bucket* b = nullptr;
+	if (pooled < max && thread->stack.base != nullptr)
+		b = bucket(thread->stack.size, false);
+
+	if (b == nullptr)
+	{
+		excess.push_back(thread);
+		return;
+	}
+
+	b->threads.push_back(thread);
+	pooled++;
+}
+
+/**
+ * Frees the threads released beyond the maximal number of pooled threads
+ */
+void ThreadPool::trim()
+{
+	Thread* thread;
+	while ((thread = excess.pop_front()) != nullptr)
+		delete thread;
+}
+
+/**
+ * Sets the pool size
+ * @param warm the number of threads with STACK_SIZE stacks to allocate in advance
+ * @param max the maximal number of pooled threads, threads released beyond it are freed by the next trim
+ */
+void ThreadPool::configure(int warm, int max)
+{
+	this->max = max;
+	trim();
+
+	// trim the pool down to the new maximum
+	for (size_t i = 0; i < buckets.size() && pooled > max; ++i)
+	{
+		while (pooled > max && !buckets[i].threads.empty())
+		{
+			delete buckets[i].threads.pop_front();
+			pooled--;
+		}
+	}
+
+	// the threads of the default stack size are released without adding a bucket
+	if (max > 0)
+		bucket(Stack::roundSize(STACK_SIZE), true);
+
+	while (pooled < warm && pooled < max)
+	{
+		Thread* thread = allocate(0, nullptr, nullptr, STACK_SIZE);
+		if (thread == nullptr)
+		{
+			std::cerr << SYS_ERR_HEADER << SYS_ERR_STACK_ALLOC;
+			exit(1);
+		}
+		release(thread);
+	}
+}
+
+
+//------------------------------------- Private Methods --------------------------------------------
+
+
+/**
+ * Returns the bucket of the given stack size
+ * @param stackSize the stack size, rounded to whole pages
+ * @param create add the bucket if missing and there are less than POOL_MAX_BUCKETS
+ * @return the bucket, nullptr if missing and not created
+ */
+ThreadPool::Bucket* ThreadPool::bucket(size_t stackSize, bool create)
+{
+	for (size_t i = 0; i < buckets.size(); ++i)
+		if (buckets[i].stackSize == stackSize)
+			return &buckets[i];
+
+	if (!create || buckets.size() >= POOL_MAX_BUCKETS)
+		return nullptr;
+
+	try {
+		buckets.push_back(Bucket());
+	} catch (std::bad_alloc& e) {
+		std::cerr << SYS_ERR_HEADER << SYS_ERR_MEM_ALLOC;
+		exit(1);
+	}
+	buckets.back().stackSize = stackSize;
+	return &buckets.back();
+}
+
+/**
+ * Allocates a new thread and its stack
+ * Terminates the process if the thread can't be allocated
+ * @param id the thread id
+ * @param f the function the thread wraps
+ * @param arg the argument of the function
+ * @param stackSize the stack size in bytes
+ * @return the thread, nullptr if the stack can't be mapped
+ */
+Thread* ThreadPool::allocate(int id, void* (*f)(void*), void* arg, size_t stackSize)
+{
+	Thread* thread;
+	try {
+		thread = new Thread(id, f, arg);
+	} catch (std::bad_alloc& e) {
+		std::cerr << SYS_ERR_HEADER << SYS_ERR_MEM_ALLOC;
+		exit(1);
+	}
+
+	// the stack size is chosen by the caller, a mapping that fails isn't fatal
+	if (!thread->stack.allocate(stackSize))
+	{
+		delete thread;
+		return nullptr;
+	}
+
+	return thread;
+}
@@ -0,0 +1,121 @@
+#ifndef UTHREADS_THREADPOOL_H
+#define UTHREADS_THREADPOOL_H
+
+#include <stddef.h>
+#include <deque>
+#include "thread.h"
+#include "threadqueue.h"
+
+/**
+ * Default maximal number of threads kept in the pool
+ */
+#define POOL_DEFAULT_MAX 64
+
+/**
+ * Maximal number of distinct stack sizes pooled, threads of other sizes aren't pooled
+ */
+#define POOL_MAX_BUCKETS 8
+
+
+/**
+ * Pool of terminated threads kept with their stacks
+ * Spawning a thread reuses a pooled thread with the same stack size, so in steady
+ * state spawning and terminating threads doesn't allocate or map memory
+ * Releasing a thread never calls the allocator, so it is safe on the thread switch path
+ */
+struct ThreadPool {
+
+	/**
+	 * Returns a thread with a stack of the given size, reused from the pool if possible
+	 * Terminates the process if the thread can't be allocated
+	 * @param id the thread id
+	 * @param f the function the thread wraps
+	 * @param arg the argument of the function
+	 * @param stackSize the stack size in bytes
+	 * @return the thread, nullptr if the stack can't be mapped
+	 */
+	Thread* acquire(int id, void* (*f)(void*), void* arg, size_t stackSize);
+
+	/**
+	 * Returns a thread to the pool, or keeps it to be freed by the next trim if the pool is full
+	 * Doesn't allocate or free memory
+	 * Assumes the thread isn't in any queue
+	 * @param thread the thread to release
+	 */
+	void release(Thread* thread);
+
+	/**
+	 * Frees the threads released beyond the maximal number of pooled threads
+	 */
+	void trim();
+
+	/**
+	 * Sets the pool size
+	 * @param warm the number of threads with STACK_SIZE stacks to allocate in advance
+	 * @param max the maximal number of pooled threads, threads released beyond it are freed by the next trim
+	 */
+	void configure(int warm, int max);
+
+private:
+
+	/**
+	 * Pooled threads with stacks of a single size
+	 */
+	struct Bucket {
+
+		/**
+		 * The stack size of the threads in the bucket
+		 */
+		size_t stackSize;
+
+		/**
+		 * The pooled threads
+		 */
+		ThreadQueue threads;
+	};
+
+	/**
+	 * The pooled threads by stack size
+	 * Holds at most POOL_MAX_BUCKETS sizes, so it is searched linearly
+	 * A deque keeps the queues in place as buckets are added, the pooled threads point to them
+	 */
+	std::deque<Bucket> buckets;
+
+	/**
+	 * Threads released beyond the maximal number of pooled threads, without a stack, or of a
+	 * stack size without a bucket
+	 * Freed by the next trim, release runs on the switch path where freeing isn't safe
+	 */
+	ThreadQueue excess;
+
+	/**
+	 * The number of pooled threads
+	 */
+	int pooled = 0;
+
+	/**
+	 * The maximal number of pooled threads
+	 */
+	int max = POOL_DEFAULT_MAX;
+
+	/**
+	 * Returns the bucket of the given stack size
+	 * @param stackSize the stack size, rounded to whole pages
+	 * @param create add the bucket if missing and there are less than POOL_MAX_BUCKETS
+	 * @return the bucket, nullptr if missing and not created
+	 */
+	Bucket* bucket(size_t stackSize, bool create);
+
+	/**
+	 * Allocates a new thread and its stack
+	 * Terminates the process if the thread can't be allocated
+	 * @param id the thread id
+	 * @param f the function the thread wraps
+	 * @param arg the argument of the function
+	 * @param stackSize the stack size in bytes
+	 * @return the thread, nullptr if the stack can't be mapped
+	 */
+	static Thread* allocate(int id, void* (*f)(void*), void* arg, size_t stackSize);
+};
+
+#endif //UTHREADS_THREADPOOL_H
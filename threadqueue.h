@@ -0,0 +1,112 @@
+#ifndef UTHREADS_THREADQUEUE_H
+#define UTHREADS_THREADQUEUE_H
+
+
+/**
+ * Intrusive doubly linked FIFO queue
+ * The links are embedded in the queued elements, T must have the members
+ * T* prev, T* next and IntrusiveQueue<T>* queue (the queue the element is in)
+ * No memory is allocated and every operation is O(1)
+ * An element can be in a single queue at a time
+ */
+template <typename T>
+struct IntrusiveQueue {
+
+	/**
+	 * Returns true if the queue is empty
+	 */
+	bool empty() const
+	{
+		return head == nullptr;
+	}
+
+	/**
+	 * Returns the first element in the queue, nullptr if the queue is empty
+	 */
+	T* front() const
+	{
+		return head;
+	}
+
+	/**
+	 * Check if an element is in the queue
+	 * @param element the element to look for
+	 * @return true if in the queue, otherwise false
+	 */
+	bool contains(const T* element) const
+	{
+		return element->queue == this;
+	}
+
+	/**
+	 * Adds an element to the end of the queue
+	 * Assumes the element isn't in any queue
+	 * @param element the element to add
+	 */
+	void push_back(T* element)
+	{
+		element->prev = tail;
+		element->next = nullptr;
+		element->queue = this;
+		if (tail != nullptr)
+			tail->next = element;
+		else
+			head = element;
+		tail = element;
+	}
+
+	/**
+	 * Removes the first element of the queue
+	 * @return the removed element, nullptr if the queue is empty
+	 */
+	T* pop_front()
+	{
+		T* element = head;
+		if (element != nullptr)
+			remove(element);
+		return element;
+	}
+
+	/**
+	 * Removes an element from the queue
+	 * Assumes the element is in the queue
+	 * @param element the element to remove
+	 */
+	void remove(T* element)
+	{
+		if (element->prev != nullptr)
+			element->prev->next = element->next;
+		else
+			head = element->next;
+
+		if (element->next != nullptr)
+			element->next->prev = element->prev;
+		else
+			tail = element->prev;
+
+		element->prev = nullptr;
+		element->next = nullptr;
+		element->queue = nullptr;
+	}
+
+private:
+
+	/**
+	 * The first element in the queue
+	 */
+	T* head = nullptr;
+
+	/**
+	 * The last element in the queue
+	 */
+	T* tail = nullptr;
+};
+
+struct Thread;
+
+/**
+ * Queue of threads
+ */
+typedef IntrusiveQueue<Thread> ThreadQueue;
+
+#endif //UTHREADS_THREADQUEUE_H
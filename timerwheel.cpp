@@ -0,0 +1,211 @@
+#include "timerwheel.h"
+
+/**
+ * Mask of a slot index in a level
+ */
+#define SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+
+/**
+ * The farthest tick from the current tick a timer can be placed at
+ */
+#define MAX_DELTA ((1LL << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)) - 1)
+
+
+/**
+ * Returns the distance from the given slot to the first non empty slot at or after it
+ * @param occupied the non empty slots of a level, not 0
+ * @param index the slot to start from
+ */
+static int firstOccupied(uint64_t occupied, int index)
+{
+	uint64_t rotated = index == 0 ? occupied : (occupied >> index) | (occupied << (64 - index));
+	return __builtin_ctzll(rotated);
+}
+
+
+/**
+ * Adds a timer
+ * @param timer the timer, must not be pending
+ * @param deadline the time the timer expires at in microseconds
+ * @param now the current time in microseconds
+ */
+void TimerWheel::add(Timer* timer, long long deadline, long long now)
+{
+	// an empty wheel skips the ticks it didn't process
+	if (count == 0)
+		tick = now / TIMER_WHEEL_TICK_USECS;
+
+	// round up, a timer never fires early
+	timer->expires = (deadline + TIMER_WHEEL_TICK_USECS - 1) / TIMER_WHEEL_TICK_USECS;
+	link(timer);
+	count++;
+}
+
+/**
+ * Removes a pending timer
+ * @param timer the timer
+ */
+void TimerWheel::cancel(Timer* timer)
+{
+	unlink(timer);
+	count--;
+}
+
+/**
+ * Advances the wheel to the current time and removes the expired timers
+ * @param now the current time in microseconds
+ * @return the expired timers linked by their next field, nullptr if none expired
+ */
+Timer* TimerWheel::expire(long long now)
+{
+	long long target = now / TIMER_WHEEL_TICK_USECS;
+	Timer* expired = nullptr;
+	Timer** last = &expired;
+
+	while (tick <= target && count > 0)
+	{
+		// skip the ticks in which nothing happens
+		long long next = nextTick();
+		if (next > target)
+			break;
+		tick = next;
+
+		// the start of a level 0 round, move the timers of the next slot of level 1 down,
+		// and so on up the levels
+		int index = (int)(tick & SLOT_MASK);
+		if (index == 0)
+		{
+			for (int level = 1; level < TIMER_WHEEL_LEVELS; ++level)
+			{
+				if (cascade(level, (int)((tick >> (TIMER_WHEEL_BITS * level)) & SLOT_MASK)) != 0)
+					break;
+			}
+		}
+
+		// the timers of the tick expire
+		Timer* timer = slots[index];
+		slots[index] = nullptr;
+		occupied[0] &= ~((uint64_t)1 << index);
+		while (timer != nullptr)
+		{
+			timer->slot = -1;
+			*last = timer;
+			last = &timer->next;
+			timer = timer->next;
+			count--;
+		}
+
+		tick++;
+	}
+
+	if (tick <= target)
+		tick = target + 1;
+	*last = nullptr;
+	return expired;
+}
+
+/**
+ * Returns the earliest time the wheel may have a timer to expire, in microseconds
+ * A timer may still be a few levels up at that time, so it is a lower bound
+ * Assumes the wheel isn't empty
+ */
+long long TimerWheel::nextEvent() const
+{
+	return nextTick() * TIMER_WHEEL_TICK_USECS;
+}
+
+/**
+ * Places a timer in the slot of its expiry tick
+ */
+void TimerWheel::link(Timer* timer)
+{
+	long long delta = timer->expires - tick;
+	int level = 0;
+	int index;
+
+	if (delta < 0)
+	{
+		index = (int)(tick & SLOT_MASK);  // already due, expires in the next tick
+	}
+	else
+	{
+		long long expires = delta > MAX_DELTA ? tick + MAX_DELTA : timer->expires;
+		while (level < TIMER_WHEEL_LEVELS - 1 && delta >> (TIMER_WHEEL_BITS * (level + 1)) != 0)
+			level++;
+		index = (int)((expires >> (TIMER_WHEEL_BITS * level)) & SLOT_MASK);
+	}
+
+	timer->slot = level * TIMER_WHEEL_SLOTS + index;
+	timer->prev = nullptr;
+	timer->next = slots[timer->slot];
+	if (timer->next != nullptr)
+		timer->next->prev = timer;
+	slots[timer->slot] = timer;
+	occupied[level] |= (uint64_t)1 << index;
+}
+
+/**
+ * Removes a timer from its slot
+ */
+void TimerWheel::unlink(Timer* timer)
+{
+	if (timer->prev != nullptr)
+		timer->prev->next = timer->next;
+	else
+		slots[timer->slot] = timer->next;
+	if (timer->next != nullptr)
+		timer->next->prev = timer->prev;
+
+	if (slots[timer->slot] == nullptr)
+		occupied[timer->slot / TIMER_WHEEL_SLOTS] &= ~((uint64_t)1 << (timer->slot % TIMER_WHEEL_SLOTS));
+	timer->slot = -1;
+}
+
+/**
+ * Places the timers of a slot again, a level down
+ * @param level the level of the slot
+ * @param index the index of the slot in the level
+ * @return the index
+ */
+int TimerWheel::cascade(int level, int index)
+{
+	int slot = level * TIMER_WHEEL_SLOTS + index;
+	Timer* timer = slots[slot];
+	slots[slot] = nullptr;
+	occupied[level] &= ~((uint64_t)1 << index);
+
+	while (timer != nullptr)
+	{
+		Timer* next = timer->next;
+		link(timer);
+		timer = next;
+	}
+	return index;
+}
+
+/**
+ * Returns the next tick in which a timer expires or is moved down a level
+ */
+long long TimerWheel::nextTick() const
+{
+	// a level 0 slot expires in the tick it stands for
+	long long next = -1;
+	if (occupied[0] != 0)
+		next = tick + firstOccupied(occupied[0], (int)(tick & SLOT_MASK));
+
+	// a slot of a higher level is moved down at the start of its round
+	for (int level = 1; level < TIMER_WHEEL_LEVELS; ++level)
+	{
+		if (occupied[level] == 0)
+			continue;
+
+		long long span = 1LL << (TIMER_WHEEL_BITS * level);
+		long long round = (tick + span - 1) & ~(span - 1);
+		int index = (int)((round >> (TIMER_WHEEL_BITS * level)) & SLOT_MASK);
+		long long cascade = round + firstOccupied(occupied[level], index) * span;
+		if (next == -1 || cascade < next)
+			next = cascade;
+	}
+
+	return next;
+}
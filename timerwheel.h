@@ -0,0 +1,158 @@
+#ifndef UTHREADS_TIMERWHEEL_H
+#define UTHREADS_TIMERWHEEL_H
+
+#include <stdint.h>
+
+struct Thread;
+
+/**
+ * Length of a timing wheel tick in microseconds, timers fire at a tick boundary
+ */
+#define TIMER_WHEEL_TICK_USECS 100
+
+/**
+ * Number of levels of the timing wheel
+ */
+#define TIMER_WHEEL_LEVELS 4
+
+/**
+ * Every level has 2 ^ TIMER_WHEEL_BITS slots
+ */
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+
+
+/**
+ * A timer of a thread, kept in a slot of the timing wheel
+ */
+struct Timer {
+
+	/**
+	 * The tick the timer expires at
+	 */
+	long long expires = 0;
+
+	/**
+	 * The thread woken up when the timer expires
+	 */
+	Thread* thread = nullptr;
+
+	/**
+	 * The previous timer in the slot
+	 */
+	Timer* prev = nullptr;
+
+	/**
+	 * The next timer in the slot, or in the list of expired timers
+	 */
+	Timer* next = nullptr;
+
+	/**
+	 * The slot the timer is in, -1 if the timer isn't pending
+	 */
+	int slot = -1;
+
+	/**
+	 * Returns true if the timer is in the timing wheel
+	 */
+	bool pending() const
+	{
+		return slot != -1;
+	}
+};
+
+/**
+ * Hierarchical timing wheel
+ * Level 0 has a slot for each of the next TIMER_WHEEL_SLOTS ticks, and each slot of
+ * level l covers TIMER_WHEEL_SLOTS ^ l ticks. Adding and cancelling a timer is O(1),
+ * and a timer is moved a level down when the wheel reaches its slot, at most
+ * TIMER_WHEEL_LEVELS - 1 times. Timers further than the last level are kept in its
+ * farthest slot and placed again when it is reached.
+ * Ticks in which nothing happens are skipped, found through a bitmap of the non empty
+ * slots of every level, so pending timers cost nothing until they fire
+ */
+struct TimerWheel {
+
+	/**
+	 * Adds a timer
+	 * @param timer the timer, must not be pending
+	 * @param deadline the time the timer expires at in microseconds
+	 * @param now the current time in microseconds
+	 */
+	void add(Timer* timer, long long deadline, long long now);
+
+	/**
+	 * Removes a pending timer
+	 * @param timer the timer
+	 */
+	void cancel(Timer* timer);
+
+	/**
+	 * Advances the wheel to the current time and removes the expired timers
+	 * @param now the current time in microseconds
+	 * @return the expired timers linked by their next field, nullptr if none expired
+	 */
+	Timer* expire(long long now);
+
+	/**
+	 * Returns the earliest time the wheel may have a timer to expire, in microseconds
+	 * A timer may still be a few levels up at that time, so it is a lower bound
+	 * Assumes the wheel isn't empty
+	 */
+	long long nextEvent() const;
+
+	/**
+	 * Returns true if there are no pending timers
+	 */
+	bool empty() const
+	{
+		return count == 0;
+	}
+
+private:
+
+	/**
+	 * The timers of every slot, level after level
+	 */
+	Timer* slots[TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS] = {};
+
+	/**
+	 * Bit s of occupied[l] is set if slot s of level l isn't empty
+	 */
+	uint64_t occupied[TIMER_WHEEL_LEVELS] = {};
+
+	/**
+	 * The next tick to process
+	 */
+	long long tick = 0;
+
+	/**
+	 * The number of pending timers
+	 */
+	int count = 0;
+
+	/**
+	 * Places a timer in the slot of its expiry tick
+	 */
+	void link(Timer* timer);
+
+	/**
+	 * Removes a timer from its slot
+	 */
+	void unlink(Timer* timer);
+
+	/**
+	 * Places the timers of a slot again, a level down
+	 * @param level the level of the slot
+	 * @param index the index of the slot in the level
+	 * @return the index
+	 */
+	int cascade(int level, int index);
+
+	/**
+	 * Returns the next tick in which a timer expires or is moved down a level
+	 */
+	long long nextTick() const;
+};
+
+#endif //UTHREADS_TIMERWHEEL_H
@@ -1,16 +1,102 @@
 #include <iostream>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
 #include <signal.h>
+#include <unistd.h>
 #include "uthreads.h"
 #include "thread.h"
 #include "scheduler.h"
 #include "messages.h"
-#include "blackbox.h"
+#include "context.h"
 
 /**
  * Instance of the scheduler
  */
 static Scheduler* scheduler = Scheduler::instance();
 
+/**
+ * Entry point of every spawned thread
+ * Runs the thread function and terminates the thread if the function returns
+ * @param t the thread
+ */
+static void threadStart(void* t)
+{
+	Thread* thread = static_cast<Thread*>(t);
+
+	// the thread is switched to inside a critical section
+	scheduler->unblockTimerThreadSwitch();
+
+	thread->run();
+	uthread_terminate(thread->id);
+}
+
+/**
+ * Thread function of the threads spawned with a function without argument and result
+ * @param f the function
+ * @return nullptr
+ */
+static void* runVoid(void* f)
+{
+	reinterpret_cast<void (*)(void)>(f)();
+	return nullptr;
+}
+
+/**
+ * Creates a thread for the given function with a stack of the given size.
+ * @param f the function the thread should wrap
+ * @param arg the argument of the function
+ * @param stack_size the stack size in bytes
+ * @param joinable true if the thread keeps its id after it terminates, until joined
+ * @return the id of the thread if successful, otherwise -1
+ */
+static int spawnThread(void* (*f)(void*), void* arg, size_t stack_size, bool joinable)
+{
+	if (stack_size == 0 || stack_size > UTHREAD_MAX_STACK_SIZE)
+	{
+		std::cerr << LIB_ERR_HEADER << LIB_ERR_STACK_SIZE;
+		return -1;
+	}
+
+	// leave room for the signal handler and the scheduler below the thread frames
+	if (stack_size < UTHREAD_MIN_STACK_SIZE)
+		stack_size = UTHREAD_MIN_STACK_SIZE;
+
+	// ignore timer signal in critical code
+	scheduler->blockTimerThreadSwitch();
+
+	int tid = scheduler->id();
+	if (tid == -1)
+	{
+		std::cerr << LIB_ERR_HEADER << LIB_ERR_MAX_THREAD;
+		scheduler->unblockTimerThreadSwitch();
+		return -1;  // number of threads exceed the limit
+	}
+
+	// reuse a pooled thread and stack if possible, including the threads terminated since the last reap
+	scheduler->reap();
+	Thread* thread = scheduler->pool.acquire(tid, f, arg, stack_size);
+	if (thread == nullptr)
+	{
+		std::cerr << LIB_ERR_HEADER << LIB_ERR_STACK_ALLOC;
+		scheduler->releaseId(tid);
+		scheduler->unblockTimerThreadSwitch();
+		return -1;
+	}
+	thread->joinable = joinable;
+
+	// prepare the thread stack so the first switch to the thread starts f
+	contextInit(&thread->context, thread->stack.base, thread->stack.size, threadStart, thread);
+
+	// add thread to scheduler
+	scheduler->add(thread);
+
+    // unblock timer signal
+	scheduler->unblockTimerThreadSwitch();
+
+	return tid;
+}
+
 /**
  * Initialized the library.
  * @param quantum_usecs the length of a quantum in microseconds
@@ -18,25 +104,82 @@ static Scheduler* scheduler = Scheduler::instance();
  */
 int uthread_init(int quantum_usecs)
 {
-	// validate parameter
-	if (quantum_usecs <= 0)
+	uthread_options options;
+	uthread_options_init(&options);
+	options.quantum_usecs = quantum_usecs;
+
+	return uthread_init_options(&options);
+}
+
+/**
+ * Fills the given options with the defaults
+ * @param options the options to fill
+ */
+void uthread_options_init(uthread_options* options)
+{
+	options->quantum_usecs = 0;
+	options->max_threads = MAX_THREAD_NUM;
+	options->initial_threads = MAX_THREAD_NUM;
+	options->pool_warm_threads = 0;
+	options->pool_max_threads = POOL_DEFAULT_MAX;
+	options->workers = 1;
+	options->cooperative = 0;
+	options->policy = UTHREAD_SCHED_RR;
+	options->tickless = 0;
+	options->max_quantum_usecs = 0;
+	options->clock = UTHREAD_CLOCK_VIRTUAL;
+	options->io_backend = UTHREAD_IO_EPOLL;
+	options->offload_threads = OFFLOAD_DEFAULT_THREADS;
+}
+
+/**
+ * Initialized the library with the given options.
+ * @param options the library options
+ * @return 0 if successful, otherwise -1
+ */
+int uthread_init_options(const uthread_options* options)
+{
+	// validate parameters, a cooperative scheduler has no quantum
+	if (options->quantum_usecs <= 0 && !options->cooperative)
 	{
 		std::cerr << LIB_ERR_HEADER << LIB_ERR_QUANTUM;
 		return -1;
 	}
+	if (options->max_threads < 0 || options->initial_threads < 0 ||
+		options->pool_warm_threads < 0 || options->pool_max_threads < 0 || options->workers < 1 ||
+		options->offload_threads < 1 ||
+		options->max_quantum_usecs < 0 ||
+		options->policy < UTHREAD_SCHED_RR || options->policy > UTHREAD_SCHED_FAIR ||
+		(options->policy != UTHREAD_SCHED_RR && options->workers > 1) ||
+		(options->tickless && options->workers > 1) ||
+		options->clock < UTHREAD_CLOCK_VIRTUAL || options->clock > UTHREAD_CLOCK_MONOTONIC ||
+		options->io_backend < UTHREAD_IO_EPOLL || options->io_backend > UTHREAD_IO_URING)
+	{
+		std::cerr << LIB_ERR_HEADER << LIB_ERR_OPTIONS;
+		return -1;
+	}
 
-	scheduler->setQuantumLength(quantum_usecs);   // set the quantum time in the scheduler
+	scheduler->setQuantumLength(options->quantum_usecs);   // set the quantum time in the scheduler
+	scheduler->setThreadLimit(options->max_threads, options->initial_threads);
+	scheduler->pool.configure(options->pool_warm_threads, options->pool_max_threads);
+	scheduler->setCooperative(options->cooperative != 0);
+	scheduler->setClock(options->clock);
+	scheduler->setIoBackend(options->io_backend);
+	scheduler->setOffloadThreads(options->offload_threads);
+	scheduler->setPolicy(options->policy);
+	scheduler->setTickless(options->tickless && !options->cooperative, options->max_quantum_usecs);
+	scheduler->setWorkers(options->workers);
 
 	// add the main thread to the scheduler
 	Thread* mainThread;
 	try {
-		 mainThread = new Thread(MAIN_THREAD_ID);
+		 mainThread = new Thread(scheduler->id());   // the first id is MAIN_THREAD_ID
 	} catch (std::bad_alloc& e) {
 		std::cerr << SYS_ERR_HEADER << SYS_ERR_MEM_ALLOC;
 		exit(1);
 	}
 
-	scheduler->add(mainThread);
+	scheduler->start(mainThread);
 
 	return 0;
 }
@@ -48,44 +191,29 @@ int uthread_init(int quantum_usecs)
  */
 int uthread_spawn(void (*f)(void))
 {
-	// ignore timer signal in critical code
-	scheduler->blockTimerThreadSwitch();
-
-	int tid = scheduler->id();
-	if (tid == -1)
-	{
-		std::cerr << LIB_ERR_HEADER << LIB_ERR_MAX_THREAD;
-		return -1;  // number of threads exceed the limit
-	}
-
-	Thread* thread;
-	try {
-		thread = new Thread(tid, f);
-	} catch (std::bad_alloc& e) {
-		std::cerr << SYS_ERR_HEADER << SYS_ERR_MEM_ALLOC;
-		exit(1);
-	}
-
-	// save the thread environment
-	address_t sp, pc;
-	sp = (address_t)(thread->stack) + STACK_SIZE - sizeof(address_t);
-	pc = (address_t)f;
-	sigsetjmp(thread->env, 1);
-	(thread->env->__jmpbuf)[JB_SP] = translate_address(sp);
-	(thread->env->__jmpbuf)[JB_PC] = translate_address(pc);
-	if (sigemptyset(&(thread->env->__saved_mask)) == -1)
-	{
-		std::cerr << SYS_ERR_HEADER << SYS_ERR_SIG_INIT;
-		exit(1);
-	}
-
-	// add thread to scheduler
-	scheduler->add(thread);
+	return uthread_spawn_stack(f, STACK_SIZE);
+}
 
-    // unblock timer signal
-	scheduler->unblockTimerThreadSwitch();
+/**
+ * Creates a thread for the given function with a stack of the given size.
+ * @param f the function the thread should wrap
+ * @param stack_size the stack size in bytes
+ * @return the id of the thread if successful, otherwise -1
+ */
+int uthread_spawn_stack(void (*f)(void), size_t stack_size)
+{
+	return spawnThread(runVoid, reinterpret_cast<void*>(f), stack_size, false);
+}
 
-	return tid;
+/**
+ * Creates a joinable thread for the given function and argument.
+ * @param f the function the thread should wrap
+ * @param arg the argument of the function
+ * @return the id of the thread if successful, otherwise -1
+ */
+int uthread_spawn_arg(void* (*f)(void*), void* arg)
+{
+	return spawnThread(f, arg, STACK_SIZE, true);
 }
 
 /**
@@ -140,6 +268,687 @@ int uthread_resume(int tid)
 	return retVal;
 }
 
+/**
+ * Queues the resume of a blocked thread, safe in signal handlers and other kernel threads
+ * @param tid the thread to resume
+ * @return 0 if successful, otherwise -1
+ */
+int uthread_resume_async(int tid)
+{
+	// no critical section, the caller may not be a thread of the library
+	return scheduler->resumeAsync(tid);
+}
+
+/**
+ * Moves the running thread to the end of the ready threads and switches threads
+ * @return 0
+ */
+int uthread_yield()
+{
+	scheduler->blockTimerThreadSwitch();
+	scheduler->yield();
+	scheduler->unblockTimerThreadSwitch();
+	return 0;
+}
+
+/**
+ * Switches directly to the requested thread, the running thread goes to the end of the ready threads
+ * @param tid the thread to switch to
+ * @return 0 if successful, otherwise -1
+ */
+int uthread_yield_to(int tid)
+{
+	scheduler->blockTimerThreadSwitch();
+
+	int retVal = scheduler->yieldTo(tid);
+	if (retVal == -1)
+		std::cerr << LIB_ERR_HEADER << LIB_ERR_YIELD_TO;
+
+	scheduler->unblockTimerThreadSwitch();
+	return retVal;
+}
+
+/**
+ * Makes the running thread sleep for at least the given time
+ * @param usec the time in microseconds
+ * @return 0 if successful, otherwise -1
+ */
+int uthread_sleep_usec(int usec)
+{
+	scheduler->blockTimerThreadSwitch();
+
+	int retVal = scheduler->sleep(usec);
+	if (retVal == -1)
+		std::cerr << LIB_ERR_HEADER << LIB_ERR_SLEEP;
+
+	scheduler->unblockTimerThreadSwitch();
+	return retVal;
+}
+
+/**
+ * Makes the running thread wait until a file descriptor is ready, or until the timeout
+ * @param fd the file descriptor
+ * @param events the UTHREAD_FD_ events to wait for
+ * @param timeout_usecs the timeout in microseconds, -1 for no timeout
+ * @return the ready events, 0 if the timeout passed, -1 on failure
+ */
+int uthread_wait_fd(int fd, int events, int timeout_usecs)
+{
+	scheduler->blockTimerThreadSwitch();
+
+	int retVal = scheduler->waitFd(fd, events, timeout_usecs);
+	int savedErrno = errno;  // a deferred switch at the end of the critical section may change it
+	if (retVal == -1)
+		std::cerr << LIB_ERR_HEADER << LIB_ERR_WAIT_FD;
+
+	scheduler->unblockTimerThreadSwitch();
+	errno = savedErrno;
+	return retVal;
+}
+
+/**
+ * Makes the running thread wait on an address if it holds the expected value, until a
+ * thread wakes the address or until the timeout
+ * @param addr the address
+ * @param expected the value the address must hold
+ * @param timeout_usecs the timeout in microseconds, -1 for no timeout
+ * @return 0 if woken up, -1 with errno set to EAGAIN if the value isn't expected, or to
+ * ETIMEDOUT if the timeout passed, -1 on failure
+ */
+int uthread_wait(int* addr, int expected, int timeout_usecs)
+{
+	if (addr == nullptr)
+	{
+		std::cerr << LIB_ERR_HEADER << LIB_ERR_WAIT;
+		errno = EINVAL;
+		return -1;
+	}
+
+	scheduler->blockTimerThreadSwitch();
+	int retVal = scheduler->waitAddress(addr, expected, timeout_usecs);
+	int savedErrno = errno;
+	scheduler->unblockTimerThreadSwitch();
+	errno = savedErrno;
+	return retVal;
+}
+
+/**
+ * Wakes up the threads waiting on an address
+ * @param addr the address
+ * @param n the maximal number of threads to wake up
+ * @return the number of woken up threads, -1 on failure
+ */
+int uthread_wake(int* addr, int n)
+{
+	if (addr == nullptr || n < 1)
+	{
+		std::cerr << LIB_ERR_HEADER << LIB_ERR_WAKE;
+		return -1;
+	}
+
+	// pairs with the waiter counting itself before it reads the value, either the waiter
+	// sees the new value or the waker sees the waiter
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&scheduler->waitBucket(addr)->nWaiting, __ATOMIC_RELAXED) == 0)
+		return 0;
+
+	scheduler->blockTimerThreadSwitch();
+	int retVal = scheduler->wakeAddress(addr, n);
+	scheduler->unblockTimerThreadSwitch();
+	return retVal;
+}
+
+/**
+ * Waits until a file descriptor is ready for an I/O call that would block
+ * @param fd the file descriptor
+ * @param events the UTHREAD_FD_ events to wait for
+ * @return 0 if ready, -1 on failure with errno set
+ */
+static int waitIo(int fd, int events)
+{
+	scheduler->blockTimerThreadSwitch();
+	int retVal = scheduler->waitFd(fd, events, -1);
+	int savedErrno = errno;
+	scheduler->unblockTimerThreadSwitch();
+	errno = savedErrno;
+	return retVal == -1 ? -1 : 0;
+}
+
+/**
+ * Makes an I/O call on the io_uring ring, the running thread waits for its completion
+ * @param opcode the IORING_OP_ operation
+ * @param fd the file descriptor
+ * @param addr the buffer, or the operation specific address
+ * @param len the buffer length
+ * @param offset the file offset, -1 for the file position, or the operation specific value
+ * @param flags the operation specific flags
+ * @param result set to the result of the call, -1 on failure with errno set
+ * @return true if the call was made, false if it must be made directly
+ */
+static bool ringIo(int opcode, int fd, const void* addr, size_t len, unsigned long long offset,
+				   unsigned flags, ssize_t* result)
+{
+	if (!scheduler->ring.active())
+		return false;
+
+	scheduler->blockTimerThreadSwitch();
+	int res;
+	bool made = scheduler->ringIo(opcode, fd, addr, len > INT_MAX ? INT_MAX : (unsigned)len, offset, flags,
+								  -1, &res);
+	scheduler->unblockTimerThreadSwitch();
+
+	// a kernel that doesn't poll a file that isn't ready fails the call, wait for it instead
+	if (!made || res == -EAGAIN)
+		return false;
+
+	if (res < 0)
+	{
+		errno = -res;
+		*result = -1;
+	}
+	else
+	{
+		*result = res;
+	}
+	return true;
+}
+
+/**
+ * read(2) that blocks only the running thread
+ */
+ssize_t uthread_read(int fd, void* buf, size_t count)
+{
+	ssize_t n;
+	if (ringIo(IORING_OP_READ, fd, buf, count, (unsigned long long)-1, 0, &n))
+		return n;
+
+	for (;;)
+	{
+		n = read(fd, buf, count);
+		if (n != -1 || (errno != EAGAIN && errno != EWOULDBLOCK))
+			return n;
+		if (waitIo(fd, UTHREAD_FD_READ) == -1)
+			return -1;
+	}
+}
+
+/**
+ * write(2) that blocks only the running thread
+ */
+ssize_t uthread_write(int fd, const void* buf, size_t count)
+{
+	ssize_t n;
+	if (ringIo(IORING_OP_WRITE, fd, buf, count, (unsigned long long)-1, 0, &n))
+		return n;
+
+	for (;;)
+	{
+		n = write(fd, buf, count);
+		if (n != -1 || (errno != EAGAIN && errno != EWOULDBLOCK))
+			return n;
+		if (waitIo(fd, UTHREAD_FD_WRITE) == -1)
+			return -1;
+	}
+}
+
+/**
+ * pread(2) that blocks only the running thread
+ */
+ssize_t uthread_pread(int fd, void* buf, size_t count, off_t offset)
+{
+	ssize_t n;
+	if (offset >= 0 && ringIo(IORING_OP_READ, fd, buf, count, (unsigned long long)offset, 0, &n))
+		return n;
+
+	for (;;)
+	{
+		n = pread(fd, buf, count, offset);
+		if (n != -1 || (errno != EAGAIN && errno != EWOULDBLOCK))
+			return n;
+		if (waitIo(fd, UTHREAD_FD_READ) == -1)
+			return -1;
+	}
+}
+
+/**
+ * pwrite(2) that blocks only the running thread
+ */
+ssize_t uthread_pwrite(int fd, const void* buf, size_t count, off_t offset)
+{
+	ssize_t n;
+	if (offset >= 0 && ringIo(IORING_OP_WRITE, fd, buf, count, (unsigned long long)offset, 0, &n))
+		return n;
+
+	for (;;)
+	{
+		n = pwrite(fd, buf, count, offset);
+		if (n != -1 || (errno != EAGAIN && errno != EWOULDBLOCK))
+			return n;
+		if (waitIo(fd, UTHREAD_FD_WRITE) == -1)
+			return -1;
+	}
+}
+
+/**
+ * accept(2) that blocks only the running thread, the accepted socket is non-blocking
+ */
+int uthread_accept(int fd, struct sockaddr* addr, socklen_t* addrlen)
+{
+	// the address length pointer takes the place of the offset
+	ssize_t client;
+	if (ringIo(IORING_OP_ACCEPT, fd, addr, 0, (unsigned long long)(uintptr_t)addrlen, SOCK_NONBLOCK, &client))
+		return (int)client;
+
+	for (;;)
+	{
+		client = accept4(fd, addr, addrlen, SOCK_NONBLOCK);
+		if (client != -1 || (errno != EAGAIN && errno != EWOULDBLOCK))
+			return (int)client;
+		if (waitIo(fd, UTHREAD_FD_READ) == -1)
+			return -1;
+	}
+}
+
+/**
+ * Calls a blocking function on a kernel thread of the offload pool, only the running thread waits
+ * @param fn the function to call
+ * @param arg the argument of the function
+ * @return the return value of the function, nullptr on failure
+ */
+void* uthread_offload(void* (*fn)(void*), void* arg)
+{
+	if (fn == nullptr)
+	{
+		std::cerr << LIB_ERR_HEADER << LIB_ERR_OFFLOAD;
+		return nullptr;
+	}
+
+	scheduler->blockTimerThreadSwitch();
+	void* retVal = scheduler->offload(fn, arg);
+	int savedErrno = errno;  // the errno of the call
+	scheduler->unblockTimerThreadSwitch();
+	errno = savedErrno;
+	return retVal;
+}
+
+/**
+ * Initializes a mutex to unlocked
+ * @param mutex the mutex
+ * @return 0
+ */
+int uthread_mutex_init(uthread_mutex_t* mutex)
+{
+	*mutex = UTHREAD_MUTEX_INITIALIZER;
+	return 0;
+}
+
+/**
+ * Locks a mutex, the running thread waits for it if it is locked
+ * @param mutex the mutex
+ * @return 0
+ */
+int uthread_mutex_lock(uthread_mutex_t* mutex)
+{
+	// uncontended, no critical section
+	int unlocked = 0;
+	if (__atomic_compare_exchange_n(&mutex->state, &unlocked, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		return 0;
+
+	scheduler->blockTimerThreadSwitch();
+	scheduler->lockMutex(mutex);
+	scheduler->unblockTimerThreadSwitch();
+	return 0;
+}
+
+/**
+ * Locks a mutex if it is unlocked
+ * @param mutex the mutex
+ * @return 0 if locked, -1 if the mutex is locked already
+ */
+int uthread_mutex_trylock(uthread_mutex_t* mutex)
+{
+	int unlocked = 0;
+	return __atomic_compare_exchange_n(&mutex->state, &unlocked, 1, false, __ATOMIC_ACQUIRE,
+									   __ATOMIC_RELAXED) ? 0 : -1;
+}
+
+/**
+ * Unlocks a mutex, it is handed to the first waiting thread if one waits
+ * @param mutex the mutex
+ * @return 0 if successful, -1 if the mutex isn't locked
+ */
+int uthread_mutex_unlock(uthread_mutex_t* mutex)
+{
+	// no thread waits, no critical section
+	int locked = 1;
+	if (__atomic_compare_exchange_n(&mutex->state, &locked, 0, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+		return 0;
+
+	scheduler->blockTimerThreadSwitch();
+
+	int retVal = scheduler->unlockMutex(mutex);
+	if (retVal == -1)
+		std::cerr << LIB_ERR_HEADER << LIB_ERR_MUTEX;
+
+	scheduler->unblockTimerThreadSwitch();
+	return retVal;
+}
+
+/**
+ * Initializes a condition variable no thread waits on
+ * @param cond the condition variable
+ * @return 0
+ */
+int uthread_cond_init(uthread_cond_t* cond)
+{
+	*cond = UTHREAD_COND_INITIALIZER;
+	return 0;
+}
+
+/**
+ * Unlocks a mutex, waits until a condition variable is signaled and locks the mutex again
+ * @param cond the condition variable
+ * @param mutex the mutex, held by the running thread
+ * @return 0 if successful, -1 if the mutex isn't locked
+ */
+int uthread_cond_wait(uthread_cond_t* cond, uthread_mutex_t* mutex)
+{
+	scheduler->blockTimerThreadSwitch();
+
+	int retVal = scheduler->waitCond(cond, mutex);
+	if (retVal == -1)
+		std::cerr << LIB_ERR_HEADER << LIB_ERR_MUTEX;
+
+	scheduler->unblockTimerThreadSwitch();
+	return retVal;
+}
+
+/**
+ * Wakes up the thread that waits the longest on a condition variable
+ * @param cond the condition variable
+ * @return 0
+ */
+int uthread_cond_signal(uthread_cond_t* cond)
+{
+	// no thread waits, no critical section
+	if (!__atomic_load_n(&cond->contended, __ATOMIC_SEQ_CST))
+		return 0;
+
+	scheduler->blockTimerThreadSwitch();
+	scheduler->signalCond(cond, false);
+	scheduler->unblockTimerThreadSwitch();
+	return 0;
+}
+
+/**
+ * Wakes up all the threads waiting on a condition variable
+ * @param cond the condition variable
+ * @return 0
+ */
+int uthread_cond_broadcast(uthread_cond_t* cond)
+{
+	if (!__atomic_load_n(&cond->contended, __ATOMIC_SEQ_CST))
+		return 0;
+
+	scheduler->blockTimerThreadSwitch();
+	scheduler->signalCond(cond, true);
+	scheduler->unblockTimerThreadSwitch();
+	return 0;
+}
+
+/**
+ * Initializes a semaphore
+ * @param sem the semaphore
+ * @param value the number of available units
+ * @return 0 if successful, -1 if the value is negative
+ */
+int uthread_sem_init(uthread_sem_t* sem, int value)
+{
+	if (value < 0)
+	{
+		std::cerr << LIB_ERR_HEADER << LIB_ERR_SEM;
+		return -1;
+	}
+
+	sem->value = value;
+	sem->contended = 0;
+	sem->waiters.head = nullptr;
+	sem->waiters.tail = nullptr;
+	return 0;
+}
+
+/**
+ * Takes a unit of a semaphore, the running thread waits for one if none is available
+ * @param sem the semaphore
+ * @return 0
+ */
+int uthread_sem_wait(uthread_sem_t* sem)
+{
+	if (uthread_sem_trywait(sem) == 0)
+		return 0;
+
+	scheduler->blockTimerThreadSwitch();
+	scheduler->waitSem(sem);
+	scheduler->unblockTimerThreadSwitch();
+	return 0;
+}
+
+/**
+ * Takes a unit of a semaphore if one is available
+ * @param sem the semaphore
+ * @return 0 if taken, -1 if no unit is available
+ */
+int uthread_sem_trywait(uthread_sem_t* sem)
+{
+	int value = __atomic_load_n(&sem->value, __ATOMIC_RELAXED);
+	while (value > 0)
+	{
+		if (__atomic_compare_exchange_n(&sem->value, &value, value - 1, false, __ATOMIC_ACQUIRE,
+										__ATOMIC_RELAXED))
+			return 0;
+	}
+	return -1;
+}
+
+/**
+ * Returns a unit to a semaphore, it is handed to the first waiting thread if one waits
+ * @param sem the semaphore
+ * @return 0
+ */
+int uthread_sem_post(uthread_sem_t* sem)
+{
+	// a waiter that checked the value before the unit was added is seen in contended
+	__atomic_add_fetch(&sem->value, 1, __ATOMIC_SEQ_CST);
+	if (!__atomic_load_n(&sem->contended, __ATOMIC_SEQ_CST))
+		return 0;
+
+	scheduler->blockTimerThreadSwitch();
+	scheduler->postSem(sem);
+	scheduler->unblockTimerThreadSwitch();
+	return 0;
+}
+
+/**
+ * Creates a channel
+ * @param chan the channel
+ * @param elem_size the size of an element in bytes
+ * @param capacity the number of elements the channel buffers
+ * @return 0 if successful, -1 if the size is 0 or the buffer is too large, errno is set
+ * to ENOMEM if the buffer can't be allocated
+ */
+int uthread_chan_init(uthread_chan_t* chan, size_t elem_size, unsigned capacity)
+{
+	if (elem_size == 0 || (capacity != 0 && elem_size > SIZE_MAX / capacity))
+	{
+		std::cerr << LIB_ERR_HEADER << LIB_ERR_CHAN_INIT;
+		return -1;
+	}
+
+	chan->buffer = nullptr;
+	if (capacity != 0)
+	{
+		try {
+			chan->buffer = new char[elem_size * capacity];
+		} catch (std::bad_alloc& e) {
+			// the capacity is chosen by the caller, a buffer too large for memory isn't fatal
+			std::cerr << LIB_ERR_HEADER << LIB_ERR_CHAN_ALLOC;
+			errno = ENOMEM;
+			return -1;
+		}
+	}
+
+	chan->elem_size = elem_size;
+	chan->capacity = capacity;
+	chan->head = 0;
+	chan->count = 0;
+	chan->closed = 0;
+	chan->senders.head = nullptr;
+	chan->senders.tail = nullptr;
+	chan->receivers.head = nullptr;
+	chan->receivers.tail = nullptr;
+	return 0;
+}
+
+/**
+ * Releases the buffer of a channel
+ * @param chan the channel
+ * @return 0 if successful, -1 if threads wait on the channel
+ */
+int uthread_chan_destroy(uthread_chan_t* chan)
+{
+	scheduler->blockTimerThreadSwitch();
+
+	int retVal = 0;
+	if (scheduler->chanBusy(chan))
+	{
+		std::cerr << LIB_ERR_HEADER << LIB_ERR_CHAN_DESTROY;
+		retVal = -1;
+	}
+	else
+	{
+		delete[] chan->buffer;
+		chan->buffer = nullptr;
+	}
+
+	scheduler->unblockTimerThreadSwitch();
+	return retVal;
+}
+
+/**
+ * Sends an element through a channel, waits while the channel is full
+ * @param chan the channel
+ * @param elem the element
+ * @return 0 if successful, -1 on failure
+ */
+int uthread_chan_send(uthread_chan_t* chan, const void* elem)
+{
+	scheduler->blockTimerThreadSwitch();
+	int retVal = scheduler->sendChan(chan, elem, true);
+	int savedErrno = errno;
+	scheduler->unblockTimerThreadSwitch();
+	errno = savedErrno;
+	return retVal;
+}
+
+/**
+ * Receives an element from a channel, waits while the channel is empty
+ * @param chan the channel
+ * @param elem set to the element
+ * @return 0 if successful, -1 on failure
+ */
+int uthread_chan_recv(uthread_chan_t* chan, void* elem)
+{
+	scheduler->blockTimerThreadSwitch();
+	int retVal = scheduler->recvChan(chan, elem, true);
+	int savedErrno = errno;
+	scheduler->unblockTimerThreadSwitch();
+	errno = savedErrno;
+	return retVal;
+}
+
+/**
+ * Sends an element through a channel if it isn't full
+ * @param chan the channel
+ * @param elem the element
+ * @return 0 if successful, -1 on failure
+ */
+int uthread_chan_try_send(uthread_chan_t* chan, const void* elem)
+{
+	scheduler->blockTimerThreadSwitch();
+	int retVal = scheduler->sendChan(chan, elem, false);
+	int savedErrno = errno;
+	scheduler->unblockTimerThreadSwitch();
+	errno = savedErrno;
+	return retVal;
+}
+
+/**
+ * Receives an element from a channel if it isn't empty
+ * @param chan the channel
+ * @param elem set to the element
+ * @return 0 if successful, -1 on failure
+ */
+int uthread_chan_try_recv(uthread_chan_t* chan, void* elem)
+{
+	scheduler->blockTimerThreadSwitch();
+	int retVal = scheduler->recvChan(chan, elem, false);
+	int savedErrno = errno;
+	scheduler->unblockTimerThreadSwitch();
+	errno = savedErrno;
+	return retVal;
+}
+
+/**
+ * Closes a channel, the threads waiting on it are woken up
+ * @param chan the channel
+ * @return 0 if successful, -1 if the channel is closed already
+ */
+int uthread_chan_close(uthread_chan_t* chan)
+{
+	scheduler->blockTimerThreadSwitch();
+	int retVal = scheduler->closeChan(chan);
+	int savedErrno = errno;
+	scheduler->unblockTimerThreadSwitch();
+	errno = savedErrno;
+	return retVal;
+}
+
+/**
+ * Sets the priority of the requested thread
+ * @param tid the thread id
+ * @param priority the new priority, 0 is the highest
+ * @return 0 if successful, otherwise -1
+ */
+int uthread_set_priority(int tid, int priority)
+{
+	scheduler->blockTimerThreadSwitch();
+
+	int retVal = scheduler->setPriority(tid, priority);
+	if (retVal == -1)
+		std::cerr << LIB_ERR_HEADER << LIB_ERR_PRIORITY;
+
+	scheduler->unblockTimerThreadSwitch();
+	return retVal;
+}
+
+/**
+ * Sets the quantum length of the requested thread
+ * @param tid the thread id
+ * @param quantum_usecs the quantum length in microseconds, 0 for the library quantum
+ * @return 0 if successful, otherwise -1
+ */
+int uthread_set_quantum(int tid, int quantum_usecs)
+{
+	scheduler->blockTimerThreadSwitch();
+
+	int retVal = scheduler->setQuantum(tid, quantum_usecs);
+	if (retVal == -1)
+		std::cerr << LIB_ERR_HEADER << LIB_ERR_SET_QUANTUM;
+
+	scheduler->unblockTimerThreadSwitch();
+	return retVal;
+}
+
 /**
  * Blocks the running thread until the thread with the given ID moved to running state
  * @param tid the thread to sync with the running thread
@@ -157,13 +966,31 @@ int uthread_sync(int tid)
 	return retVal;
 }
 
+/**
+ * Blocks the running thread until the requested thread terminates
+ * @param tid the thread id to join
+ * @param result set to the value the thread function returned, may be NULL
+ * @return 0 if successful, otherwise -1
+ */
+int uthread_join(int tid, void** result)
+{
+	scheduler->blockTimerThreadSwitch();
+
+	int retVal = scheduler->join(tid, result);
+	if (retVal == -1)
+		std::cerr << LIB_ERR_HEADER << LIB_ERR_JOIN;
+
+	scheduler->unblockTimerThreadSwitch();
+	return retVal;
+}
+
 /**
  * Returns the thread id of the calling thread
  * @return thread id number
  */
 int uthread_get_tid()
 {
-	return scheduler->running->id;
+	return scheduler->current()->id;
 }
 
 /**
@@ -182,5 +1009,8 @@ int uthread_get_total_quantums()
  */
 int uthread_get_quantums(int tid)
 {
-	return scheduler->quantums(tid);
+	scheduler->blockTimerThreadSwitch();
+	int retVal = scheduler->quantums(tid);
+	scheduler->unblockTimerThreadSwitch();
+	return retVal;
 }
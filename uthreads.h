@@ -7,8 +7,169 @@
  * Author: OS, os@cs.huji.ac.il
  */
 
-#define MAX_THREAD_NUM 100 /* maximal number of threads */
-#define STACK_SIZE 4096 /* stack size per thread (in bytes) */
+#include <stddef.h>   /* for size_t */
+#include <sys/types.h>  /* for ssize_t */
+#include <sys/socket.h> /* for struct sockaddr and socklen_t */
+
+#define MAX_THREAD_NUM 100 /* default maximal number of threads */
+#define STACK_SIZE 65536 /* stack size per thread (in bytes), committed lazily */
+#define UTHREAD_MIN_STACK_SIZE 16384 /* smallest thread stack, see uthread_spawn_stack */
+#define UTHREAD_MAX_STACK_SIZE ((size_t)1 << 30) /* largest thread stack */
+
+#define UTHREAD_PRIORITY_LEVELS 16 /* number of thread priorities, 0 is the highest */
+#define UTHREAD_DEFAULT_PRIORITY 8 /* priority of a new thread */
+
+/* scheduling policies, see uthread_init_options */
+#define UTHREAD_SCHED_RR 0       /* round robin */
+#define UTHREAD_SCHED_PRIORITY 1 /* strict priority, round robin within a priority */
+#define UTHREAD_SCHED_MLFQ 2     /* multi-level feedback queue */
+#define UTHREAD_SCHED_FAIR 3     /* lowest CPU time first, like the Linux CFS */
+
+/* quantum clocks, see uthread_init_options */
+#define UTHREAD_CLOCK_VIRTUAL 0   /* CPU time of the process, or of the worker in M:N mode */
+#define UTHREAD_CLOCK_MONOTONIC 1 /* wall-clock time */
+
+/* I/O backends, see uthread_init_options */
+#define UTHREAD_IO_EPOLL 0 /* readiness polling with epoll */
+#define UTHREAD_IO_URING 1 /* calls submitted in batches to io_uring */
+
+/* file descriptor events, see uthread_wait_fd */
+#define UTHREAD_FD_READ 1  /* ready for reading, or accepting a connection */
+#define UTHREAD_FD_WRITE 2 /* ready for writing */
+
+/*
+ * Library options, see uthread_init_options.
+ * Fill in the defaults with uthread_options_init before changing fields.
+ */
+typedef struct uthread_options {
+	/* length of a quantum in micro-seconds */
+	int quantum_usecs;
+
+	/* maximal number of concurrent threads, 0 for no limit. The thread table
+	 * grows on demand up to it, and thread IDs are allocated in constant time */
+	int max_threads;
+
+	/* number of thread table entries allocated by init */
+	int initial_threads;
+
+	/* number of threads with STACK_SIZE stacks allocated by init into the pool */
+	int pool_warm_threads;
+
+	/* maximal number of terminated threads kept with their stacks in a pool,
+	 * and reused by spawns with the same stack size */
+	int pool_max_threads;
+
+	/* number of kernel threads running the threads. With more than one (M:N)
+	 * the calling kernel thread is the first worker, every worker has its own
+	 * run queue and quantum timer that counts the CPU time of the worker, and
+	 * idle workers steal READY threads from the others. The threads then run
+	 * in parallel, so data shared between threads must be synchronized, and a
+	 * thread blocked by a thread on another worker stops at the end of its
+	 * next library call */
+	int workers;
+
+	/* non-zero for cooperative scheduling: no timer and no signal handler are
+	 * installed and quantum_usecs is ignored. A thread runs until it yields,
+	 * blocks, syncs or terminates, and system calls are never interrupted by
+	 * the library */
+	int cooperative;
+
+	/* order READY threads run in, one of the UTHREAD_SCHED_ values. Policies
+	 * other than round robin need a single worker. The multi-level feedback
+	 * queue starts a thread at the level of its priority, drops it a level
+	 * every time it uses its whole quantum and keeps its level when it yields
+	 * or blocks earlier, and boosts all the threads back to their priority
+	 * every 32 quantum lengths of wall-clock time, but no more often than
+	 * every 10 ms. The fair policy runs the thread that used the least CPU
+	 * time next */
+	int policy;
+
+	/* non-zero to stop the timer while no thread is READY, so a thread running
+	 * alone gets no signals. The timer starts again when a thread becomes
+	 * READY. Needs a single worker, ignored with cooperative scheduling */
+	int tickless;
+
+	/* tickless only: if larger than the quantum, the quantum doubles with
+	 * every quantum that starts with at most one READY thread, up to this
+	 * length in micro-seconds, and goes back to normal when more threads are
+	 * READY. 0 for no stretching */
+	int max_quantum_usecs;
+
+	/* what a quantum measures, one of the UTHREAD_CLOCK_ values. The virtual
+	 * clock counts the CPU time of the process (of the worker in M:N mode), so
+	 * a thread waiting in a blocking system call isn't preempted. The
+	 * monotonic clock counts wall-clock time with a timer of every worker,
+	 * stopped while the worker has no thread to run. A system call it
+	 * interrupts is restarted when the thread runs again, if the call allows
+	 * it */
+	int clock;
+
+	/* how uthread_wait_fd and the thread I/O calls wait, one of the
+	 * UTHREAD_IO_ values. epoll makes the call, and if it would block waits
+	 * for readiness and makes it again. io_uring queues the call itself in a
+	 * ring: the calls of all the threads are submitted with a single system
+	 * call once no other thread is READY, or after at most 200 micro-seconds
+	 * behind running threads, and completions are collected at thread
+	 * switches. Without kernel support (Linux 5.7 or later) epoll is used */
+	int io_backend;
+
+	/* maximal number of kernel threads running uthread_offload calls, started
+	 * when they are first needed */
+	int offload_threads;
+} uthread_options;
+
+/*
+ * FIFO queue of the threads waiting on a synchronization object, managed by
+ * the library. The queue is intrusive, so waiting allocates no memory.
+ */
+typedef struct uthread_waitq {
+	void* head;
+	void* tail;
+} uthread_waitq;
+
+/*
+ * Mutex, see uthread_mutex_lock. Initialize with UTHREAD_MUTEX_INITIALIZER
+ * or uthread_mutex_init.
+ */
+typedef struct uthread_mutex {
+	int state;             /* 0 unlocked, 1 locked, 2 locked and maybe contended */
+	uthread_waitq waiters; /* threads waiting for the mutex */
+} uthread_mutex_t;
+
+/*
+ * Condition variable, see uthread_cond_wait. Initialize with
+ * UTHREAD_COND_INITIALIZER or uthread_cond_init.
+ */
+typedef struct uthread_cond {
+	int contended;         /* non-zero while threads may be waiting */
+	uthread_waitq waiters; /* threads waiting for a signal */
+} uthread_cond_t;
+
+/*
+ * Counting semaphore, see uthread_sem_wait. Initialize with uthread_sem_init.
+ */
+typedef struct uthread_sem {
+	int value;             /* number of available units */
+	int contended;         /* non-zero while threads may be waiting */
+	uthread_waitq waiters; /* threads waiting for a unit */
+} uthread_sem_t;
+
+/*
+ * Bounded channel, see uthread_chan_send. Create with uthread_chan_init.
+ */
+typedef struct uthread_channel {
+	char* buffer;          /* ring buffer of capacity elements */
+	size_t elem_size;      /* size of an element in bytes */
+	unsigned capacity;     /* number of elements the buffer holds, 0 for rendezvous only */
+	unsigned head;         /* index of the oldest buffered element */
+	unsigned count;        /* number of buffered elements */
+	int closed;            /* non-zero once the channel is closed */
+	uthread_waitq senders;   /* threads waiting to send */
+	uthread_waitq receivers; /* threads waiting to receive */
+} uthread_chan_t;
+
+#define UTHREAD_MUTEX_INITIALIZER {0, {NULL, NULL}}
+#define UTHREAD_COND_INITIALIZER {0, {NULL, NULL}}
 
 /* External interface */
 
@@ -23,18 +184,67 @@
 */
 int uthread_init(int quantum_usecs);
 
+/*
+ * Description: This function fills the given options with the defaults used
+ * by uthread_init: no quantum length (it must be set), a limit of
+ * MAX_THREAD_NUM threads, a thread table of MAX_THREAD_NUM entries, a thread
+ * pool that starts empty and keeps up to 64 terminated threads, a single
+ * worker kernel thread, preemptive round robin scheduling with quanta of
+ * CPU time, the epoll I/O backend and up to 4 offload threads.
+*/
+void uthread_options_init(uthread_options* options);
+
+/*
+ * Description: This function initializes the thread library like uthread_init
+ * with the given options, described at their fields in uthread_options.
+ * It is an error to call this function with non-positive quantum_usecs
+ * (unless cooperative is set), negative max_threads, initial_threads,
+ * pool_warm_threads, pool_max_threads or max_quantum_usecs, less than one
+ * worker or offload thread, an unknown policy, clock or I/O backend, or
+ * more than one worker with tickless or a policy other than round robin.
+ * Return value: On success, return 0. On failure, return -1.
+*/
+int uthread_init_options(const uthread_options* options);
+
 /*
  * Description: This function creates a new thread, whose entry point is the
  * function f with the signature void f(void). The thread is added to the end
  * of the READY threads list. The uthread_spawn function should fail if it
  * would cause the number of concurrent threads to exceed the limit
- * (MAX_THREAD_NUM). Each thread should be allocated with a stack of size
- * STACK_SIZE bytes.
+ * (MAX_THREAD_NUM, or max_threads given to uthread_init_options). Each
+ * thread should be allocated with a stack of size STACK_SIZE bytes.
  * Return value: On success, return the ID of the created thread.
  * On failure, return -1.
 */
 int uthread_spawn(void (*f)(void));
 
+/*
+ * Description: This function creates a new thread like uthread_spawn, with a
+ * stack of stack_size bytes (rounded up to whole pages) instead of
+ * STACK_SIZE. The stack is mapped with a guard page below it, so a stack
+ * overflow faults immediately, and its pages are only committed when the
+ * thread touches them. The quantum signal handler and the scheduler run on
+ * the stack of the running thread, so a stack_size below
+ * UTHREAD_MIN_STACK_SIZE is raised to it. It is an error to call this
+ * function with a zero stack_size, or one above UTHREAD_MAX_STACK_SIZE, or
+ * if the stack can't be mapped.
+ * Return value: On success, return the ID of the created thread.
+ * On failure, return -1.
+*/
+int uthread_spawn_stack(void (*f)(void), size_t stack_size);
+
+/*
+ * Description: This function creates a new thread like uthread_spawn, whose
+ * entry point is the function f with the signature void* f(void* arg),
+ * called with arg. The thread is joinable: when it terminates its ID isn't
+ * freed until a thread joins it with uthread_join, which gets the value f
+ * returned. A joinable thread that terminated and wasn't joined yet still
+ * counts towards the thread limit.
+ * Return value: On success, return the ID of the created thread.
+ * On failure, return -1.
+*/
+int uthread_spawn_arg(void* (*f)(void*), void* arg);
+
 
 /*
  * Description: This function terminates the thread with ID tid and deletes
@@ -42,7 +252,12 @@ int uthread_spawn(void (*f)(void));
  * the library for this thread should be released. If no thread with ID tid
  * exists it is considered as an error. Terminating the main thread
  * (tid == 0) will result in the termination of the entire process using
- * exit(0) [after releasing the assigned library memory].
+ * exit(0) [after releasing the assigned library memory]. In M:N mode, or
+ * once offload threads were started, the other kernel threads may still use
+ * the library memory, so the process ends with _exit(0) after flushing the
+ * stdio streams, without releasing it. The ID of the thread is freed when
+ * the function returns, also in M:N mode when the thread is running on
+ * another worker, which stops running it at once.
  * Return value: The function returns 0 if the thread was successfully
  * terminated and -1 otherwise. If a thread terminates itself or the main
  * thread is terminated, the function does not return.
@@ -53,7 +268,7 @@ int uthread_terminate(int tid);
 /*
  * Description: This function blocks the thread with ID tid. The thread may
  * be resumed later using uthread_resume. If no thread with ID tid exists it
- * is considered as an error. In addition, it is an error to try syncMatrix the
+ * is considered as an error. In addition, it is an error to try block the
  * main thread (tid == 0). If a thread blocks itself, a scheduling decision
  * should be made. Blocking a thread in BLOCKED state has no
  * effect and is not considered as an error.
@@ -63,7 +278,7 @@ int uthread_block(int tid);
 
 
 /*
- * Description: This function resumes a numSyncedThreads thread with ID tid and moves
+ * Description: This function resumes a blocked thread with ID tid and moves
  * it to the READY state. Resuming a thread in a RUNNING or READY state
  * has no effect and is not considered as an error. If no thread with
  * ID tid exists it is considered as an error.
@@ -72,13 +287,26 @@ int uthread_block(int tid);
 int uthread_resume(int tid);
 
 
+/*
+ * Description: This function resumes a blocked thread with ID tid like
+ * uthread_resume, but may be called from a signal handler or from a kernel
+ * thread that doesn't run a uthread. The resume is queued and performed by
+ * the scheduler at its next thread switch, or right away if no thread is
+ * running. A queued resume of a thread that no longer exists has no effect.
+ * No error message is printed.
+ * Return value: On success, return 0. If tid is negative or too many
+ * resumes are already queued, return -1.
+*/
+int uthread_resume_async(int tid);
+
+
 /*
  * Description: This function blocks the RUNNING thread until thread with
  * ID tid will move to RUNNING state (i.e.right after the next time that
  * thread tid will stop running, the calling thread will be resumed
  * automatically). If thread with ID tid will be terminated before RUNNING
  * again, the calling thread should move to READY state right after thread
- * tid is terminated (i.e. it won’t be numSyncedThreads forever). It is considered
+ * tid is terminated (i.e. it won’t be blocked forever). It is considered
  * as an error if no thread with ID tid exists or if the main thread (tid==0)
  * calls this function. Immediately after the RUNNING thread transitions to
  * the BLOCKED state a scheduling decision should be made.
@@ -87,6 +315,257 @@ int uthread_resume(int tid);
 int uthread_sync(int tid);
 
 
+/*
+ * Description: This function blocks the RUNNING thread until the thread
+ * with ID tid, created with uthread_spawn_arg, terminates, and stores the
+ * value its function returned in *result unless result is NULL. If the
+ * thread was terminated by uthread_terminate the value is NULL. If the
+ * thread already terminated the function returns immediately. The join frees
+ * the ID of the thread, so a thread is joined once; several threads waiting
+ * to join the same thread all get its value. It is considered an error if
+ * no thread with ID tid exists or waits to be joined, if it wasn't created
+ * with uthread_spawn_arg, or if a thread joins itself. When the thread
+ * terminates a single joining thread runs next.
+ * Return value: On success, return 0. On failure, return -1.
+*/
+int uthread_join(int tid, void** result);
+
+
+/*
+ * Description: This function sets the priority of the thread with ID tid,
+ * between 0 (the highest) and UTHREAD_PRIORITY_LEVELS - 1. New threads get
+ * UTHREAD_DEFAULT_PRIORITY. Under the UTHREAD_SCHED_PRIORITY policy a READY
+ * thread runs only when no thread of a higher priority is READY, under the
+ * UTHREAD_SCHED_MLFQ policy the thread moves to the level of its new
+ * priority. The other policies ignore priorities. A READY thread moves to the
+ * end of the threads of its new priority. It is considered an error if no
+ * thread with ID tid exists or if priority is out of range.
+ * Return value: On success, return 0. On failure, return -1.
+*/
+int uthread_set_priority(int tid, int priority);
+
+
+/*
+ * Description: This function sets the quantum length of the thread with ID
+ * tid to quantum_usecs micro-seconds, or back to the quantum given to
+ * uthread_init when quantum_usecs is 0. The timer is reprogrammed when a
+ * thread with a different quantum starts running, so CPU-bound threads get
+ * CPU time in proportion to their quanta. The UTHREAD_SCHED_FAIR policy also
+ * weighs the CPU time of a thread by its quantum, so a thread with a 3 times
+ * longer quantum gets 3 times the CPU time. A change to the quantum of the
+ * RUNNING thread applies from its next quantum. It is considered an error if
+ * no thread with ID tid exists or if quantum_usecs is negative.
+ * Return value: On success, return 0. On failure, return -1.
+*/
+int uthread_set_quantum(int tid, int quantum_usecs);
+
+
+/*
+ * Description: This function moves the RUNNING thread to the end of the
+ * READY threads list and makes a scheduling decision immediately. If no
+ * other thread is READY the calling thread keeps running and starts a new
+ * quantum.
+ * Return value: Always 0.
+*/
+int uthread_yield();
+
+
+/*
+ * Description: This function moves the RUNNING thread to the end of the
+ * READY threads list and switches directly to the thread with ID tid, ahead
+ * of the other READY threads. The thread switched to runs for the rest of
+ * the current quantum instead of starting a full one, so a pair of threads
+ * that pass work back and forth switches once per exchange, and doesn't run
+ * longer than other threads. If the thread isn't READY (or, with several
+ * workers, waits in the run queue of a worker) this function acts like
+ * uthread_yield. Wake ups of a single thread by a mutex unlock, a semaphore
+ * post, a condition variable signal or a channel operation hand off to the
+ * woken thread the same way once the RUNNING thread stops. A quantum that
+ * expires returns a thread handed off to to the READY threads list. It is
+ * an error if no thread with ID tid exists.
+ * Return value: On success, return 0. On failure, return -1.
+*/
+int uthread_yield_to(int tid);
+
+
+/*
+ * Description: This function makes the running thread sleep for at least
+ * usec microseconds, and a scheduling decision is made. The thread is woken
+ * up by the first scheduling decision after the time passed: at the end of
+ * a quantum, when a thread yields or blocks, or right away if no other
+ * thread is running. Blocking and resuming a sleeping thread doesn't end
+ * its sleep. The main thread may sleep too.
+ * Return value: On success, return 0. If usec is negative, return -1.
+*/
+int uthread_sleep_usec(int usec);
+
+
+/*
+ * Description: This function makes the running thread wait until the file
+ * descriptor fd is ready for one of the given events (UTHREAD_FD_READ and
+ * UTHREAD_FD_WRITE), or until timeout_usecs micro-seconds pass, and a
+ * scheduling decision is made. The other threads keep running meanwhile:
+ * the file descriptors are polled with epoll at thread switches and while
+ * no thread can run. An error or a hang up on fd makes it ready for both
+ * events. A timeout_usecs of -1 waits without a timeout. Blocking and
+ * resuming a waiting thread doesn't end its wait. It is an error to wait
+ * for no events or unknown events, or for a file descriptor that epoll
+ * doesn't support, like a regular file. With the io_uring backend the poll
+ * is submitted to io_uring instead, and a regular file is always ready.
+ * Return value: On success, return the ready events. If the timeout passed
+ * return 0. On failure, return -1 and set errno.
+*/
+int uthread_wait_fd(int fd, int events, int timeout_usecs);
+
+
+/*
+ * Description: uthread_wait makes the running thread wait on the address
+ * addr if the int at addr holds expected, until a thread calls uthread_wake
+ * on addr, or until timeout_usecs micro-seconds pass, and a scheduling
+ * decision is made. The value is checked and the thread starts waiting
+ * atomically with respect to uthread_wake, so a thread that changes the
+ * value and then calls uthread_wake never misses a waiter. A timeout_usecs
+ * of -1 waits without a timeout. uthread_wake wakes up to n of the threads
+ * waiting on addr, in the order they started waiting, and takes no critical
+ * section if no thread waits on an address with the same hash. Like a
+ * futex, these functions let lock free data structures wait for a word to
+ * change without spinning and without knowing the thread IDs of the
+ * waiters. Blocking and resuming a waiting thread doesn't end its wait. It
+ * is an error to wait on a null addr, or to wake with a null addr or a
+ * non-positive n.
+ * Return value: uthread_wait returns 0 when woken up. If the value at addr
+ * isn't expected it returns -1 with errno set to EAGAIN, and if the timeout
+ * passed it returns -1 with errno set to ETIMEDOUT, with no error message.
+ * uthread_wake returns the number of woken up threads. On failure both
+ * return -1.
+*/
+int uthread_wait(int* addr, int expected, int timeout_usecs);
+int uthread_wake(int* addr, int n);
+
+
+/*
+ * Description: These functions are read(2), write(2), pread(2), pwrite(2)
+ * and accept(2) that block only the running thread. If the call would
+ * block, the thread waits with uthread_wait_fd until fd is ready and the
+ * call is made again. fd must be in non-blocking mode (O_NONBLOCK),
+ * otherwise the call blocks the whole process. Sockets returned by
+ * uthread_accept are in non-blocking mode.
+ * With the io_uring backend the call is submitted to io_uring and the thread
+ * waits for its completion, so it takes no system call of its own, fd may be
+ * in blocking mode, and disk reads and writes of regular files don't block
+ * the process either.
+ * Return value: Like the system calls. On failure, return -1 and set errno,
+ * no error message is printed.
+*/
+ssize_t uthread_read(int fd, void* buf, size_t count);
+ssize_t uthread_write(int fd, const void* buf, size_t count);
+ssize_t uthread_pread(int fd, void* buf, size_t count, off_t offset);
+ssize_t uthread_pwrite(int fd, const void* buf, size_t count, off_t offset);
+int uthread_accept(int fd, struct sockaddr* addr, socklen_t* addrlen);
+
+
+/*
+ * Description: This function calls fn(arg) on a kernel thread of the offload
+ * pool, for calls that block and can't be made non-blocking, like
+ * getaddrinfo, fsync or stat on a network file system. The running thread
+ * waits until fn returns and a scheduling decision is made, the other
+ * threads keep running meanwhile. fn runs outside any thread of the library
+ * with all signals blocked, so it must not call library functions. Blocking
+ * and resuming a waiting thread doesn't end its wait. A thread terminated
+ * while fn runs is released after fn returns. It is an error to call this
+ * function with a null fn.
+ * Return value: On success, return the value fn returned, and set errno to
+ * the errno fn left. On failure, return NULL.
+*/
+void* uthread_offload(void* (*fn)(void*), void* arg);
+
+
+/*
+ * Description: These functions lock and unlock a mutex shared by threads.
+ * Locking an unlocked mutex and unlocking a mutex no thread waits for take
+ * a single atomic instruction, with no system call and no critical section.
+ * A thread that locks a locked mutex waits at the end of the waiters of the
+ * mutex, and unlock hands the mutex directly to the first waiter, so the
+ * waiters get it in FIFO order. uthread_mutex_trylock locks the mutex only
+ * if it is unlocked. A mutex must be unlocked by the thread that locked it,
+ * a thread terminated while holding a mutex leaves it locked. Blocking and
+ * resuming a waiting thread doesn't end its wait. It is an error to unlock a
+ * mutex that isn't locked.
+ * Return value: On success, return 0. On failure, or if trylock finds the
+ * mutex locked, return -1.
+*/
+int uthread_mutex_init(uthread_mutex_t* mutex);
+int uthread_mutex_lock(uthread_mutex_t* mutex);
+int uthread_mutex_trylock(uthread_mutex_t* mutex);
+int uthread_mutex_unlock(uthread_mutex_t* mutex);
+
+
+/*
+ * Description: uthread_cond_wait unlocks the mutex, which the running thread
+ * must hold, waits until the condition variable is signaled and locks the
+ * mutex again. uthread_cond_signal wakes up the thread that waits the
+ * longest, uthread_cond_broadcast wakes up all the waiting threads, and both
+ * have no effect if no thread waits. Signaling a condition variable no
+ * thread waits on takes no critical section. Blocking and resuming a waiting
+ * thread doesn't end its wait.
+ * Return value: On success, return 0. On failure, return -1.
+*/
+int uthread_cond_init(uthread_cond_t* cond);
+int uthread_cond_wait(uthread_cond_t* cond, uthread_mutex_t* mutex);
+int uthread_cond_signal(uthread_cond_t* cond);
+int uthread_cond_broadcast(uthread_cond_t* cond);
+
+
+/*
+ * Description: These functions operate a counting semaphore initialized
+ * with value units. uthread_sem_wait takes a unit, and if none is available
+ * waits at the end of the waiters of the semaphore. uthread_sem_post returns
+ * a unit, handing it directly to the first waiter if one waits.
+ * uthread_sem_trywait takes a unit only if one is available. Taking an
+ * available unit and posting while no thread waits take a single atomic
+ * instruction. Blocking and resuming a waiting thread doesn't end its wait.
+ * It is an error to initialize a semaphore with a negative value.
+ * Return value: On success, return 0. On failure, or if trywait finds no
+ * available unit, return -1.
+*/
+int uthread_sem_init(uthread_sem_t* sem, int value);
+int uthread_sem_wait(uthread_sem_t* sem);
+int uthread_sem_trywait(uthread_sem_t* sem);
+int uthread_sem_post(uthread_sem_t* sem);
+
+
+/*
+ * Description: These functions pass elements of elem_size bytes between
+ * threads through a channel that buffers up to capacity elements, in FIFO
+ * order. uthread_chan_send copies the element at elem into the channel, and
+ * uthread_chan_recv copies the oldest element out of it into elem. A send
+ * to a full channel and a receive from an empty one wait until a peer
+ * arrives. An element sent while a receiver waits is copied directly into
+ * the receiver's elem, and a receive from a full channel refills it with the
+ * element of the first waiting sender, so a rendezvous takes a single copy
+ * and wakes up the waiting peer. With capacity 0 every send waits for a
+ * receiver. To pass large messages without copying them, send pointers.
+ * The try functions never wait. uthread_chan_close wakes up all the waiting
+ * threads, the elements still buffered can be received afterwards.
+ * uthread_chan_destroy releases the buffer of a channel no thread waits on.
+ * Blocking and resuming a waiting thread doesn't end its wait. It is an
+ * error to create a channel with a zero elem_size or a buffer too large to
+ * allocate, or to destroy a channel threads wait on.
+ * Return value: On success, return 0. On failure, return -1, init sets
+ * errno to ENOMEM if the buffer can't be allocated. The send and
+ * receive functions and close fail with errno set and no error message
+ * printed: EPIPE if the channel is closed (for receives, closed with no
+ * buffered element left), and EAGAIN if a try function would wait.
+*/
+int uthread_chan_init(uthread_chan_t* chan, size_t elem_size, unsigned capacity);
+int uthread_chan_destroy(uthread_chan_t* chan);
+int uthread_chan_send(uthread_chan_t* chan, const void* elem);
+int uthread_chan_recv(uthread_chan_t* chan, void* elem);
+int uthread_chan_try_send(uthread_chan_t* chan, const void* elem);
+int uthread_chan_try_recv(uthread_chan_t* chan, void* elem);
+int uthread_chan_close(uthread_chan_t* chan);
+
+
 /*
  * Description: This function returns the thread ID of the calling thread.
  * Return value: The ID of the calling thread.
@@ -116,4 +595,47 @@ int uthread_get_total_quantums();
 */
 int uthread_get_quantums(int tid);
 
+
+#ifdef __cplusplus
+
+#include <type_traits>
+
+/*
+ * Typed channel over uthread_chan_t, elements are copied with memcpy so T
+ * must be trivially copyable. The functions behave like the uthread_chan_
+ * functions they call. If the buffer can't be created, valid() returns false
+ * and the channel is closed without a buffer, so every call fails with EPIPE.
+ */
+template <typename T>
+class uthread_chan {
+	static_assert(std::is_trivially_copyable<T>::value, "channel elements must be trivially copyable");
+
+public:
+	explicit uthread_chan(unsigned capacity)
+		: created(uthread_chan_init(&chan, sizeof(T), capacity) == 0)
+	{
+		if (!created)
+		{
+			uthread_chan_init(&chan, sizeof(T), 0);
+			uthread_chan_close(&chan);
+		}
+	}
+	~uthread_chan() { uthread_chan_destroy(&chan); }
+	uthread_chan(const uthread_chan&) = delete;
+	uthread_chan& operator=(const uthread_chan&) = delete;
+
+	int send(const T& value) { return uthread_chan_send(&chan, &value); }
+	int recv(T* value) { return uthread_chan_recv(&chan, value); }
+	int try_send(const T& value) { return uthread_chan_try_send(&chan, &value); }
+	int try_recv(T* value) { return uthread_chan_try_recv(&chan, value); }
+	int close() { return uthread_chan_close(&chan); }
+	bool valid() const { return created; }
+
+private:
+	uthread_chan_t chan;
+	bool created;
+};
+
+#endif
+
 #endif
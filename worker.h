@@ -0,0 +1,81 @@
+#ifndef UTHREADS_WORKER_H
+#define UTHREADS_WORKER_H
+
+#include <pthread.h>
+#include <time.h>
+#include "context.h"
+#include "poller.h"
+#include "stack.h"
+#include "workqueue.h"
+
+struct Thread;
+
+
+/**
+ * A kernel thread that runs user threads
+ * With a single worker the main kernel thread runs all the threads. With several
+ * workers (M:N mode) each worker runs the threads of its own run queue, and an
+ * idle worker steals threads from the run queues of the other workers
+ */
+struct Worker {
+
+	/**
+	 * Index of the worker, worker 0 is the kernel thread that initialized the library
+	 */
+	int index = 0;
+
+	/**
+	 * The kernel thread of the worker
+	 */
+	pthread_t pthread;
+
+	/**
+	 * The kernel thread id of the worker, used to direct its timer signal
+	 */
+	pid_t kernelTid = 0;
+
+	/**
+	 * Ready threads queued by this worker (M:N mode)
+	 */
+	WorkQueue<Thread*> runQueue;
+
+	/**
+	 * The thread handed off to by the running thread, it runs next on the worker ahead of
+	 * the ready threads and gets the rest of the current quantum
+	 */
+	Thread* runNext = nullptr;
+
+	/**
+	 * The context of the worker idle loop, resumed when the worker has no thread to run (M:N mode)
+	 */
+	Context idleContext;
+
+	/**
+	 * Stack of the idle loop of worker 0, the other workers run it on their own kernel thread stack
+	 */
+	Stack idleStack;
+
+	/**
+	 * The per worker quantum timer (M:N mode, or wall-clock quanta)
+	 */
+	timer_t timer;
+
+	/**
+	 * True if the worker switched to its idle loop from the timer handler, the idle loop
+	 * doesn't free memory then
+	 */
+	bool preempted = false;
+
+	/**
+	 * The time slice the quantum timer of the worker is programmed with, in microseconds
+	 */
+	int slice = 0;
+
+	/**
+	 * The file descriptor events polled by the worker, kept off the stack of the thread
+	 * whose critical section or timer handler polls
+	 */
+	struct epoll_event events[POLL_EVENTS];
+};
+
+#endif //UTHREADS_WORKER_H
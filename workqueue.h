@@ -0,0 +1,187 @@
+#ifndef UTHREADS_WORKQUEUE_H
+#define UTHREADS_WORKQUEUE_H
+
+#include <stddef.h>
+#include <atomic>
+
+/**
+ * Initial capacity of a work queue, must be a power of 2
+ */
+#define WORK_QUEUE_CAPACITY 64
+
+
+/**
+ * Chase-Lev work stealing deque
+ * Items are pushed at the bottom by the single owner of the queue, and taken from
+ * the top by any kernel thread without locking, so the queue is also a FIFO queue
+ * that other kernel threads can steal from. The circular buffer is grown by reserve,
+ * so push never allocates, and retired buffers are kept until the queue is destroyed
+ * since a thief may still read them
+ * T must be trivially copyable (a pointer)
+ */
+template <typename T>
+struct WorkQueue {
+
+	/**
+	 * Work queue constructor
+	 */
+	WorkQueue() : buffer(new Buffer(WORK_QUEUE_CAPACITY, nullptr)) {}
+
+	/**
+	 * Work queue destructor
+	 * Frees the current and retired buffers
+	 */
+	~WorkQueue()
+	{
+		Buffer* b = buffer.load(std::memory_order_relaxed);
+		while (b != nullptr)
+		{
+			Buffer* retired = b->retired;
+			delete b;
+			b = retired;
+		}
+	}
+
+	/**
+	 * Makes room for the given number of items, so push() never allocates
+	 * Must not run concurrently with push
+	 * @param n the number of items
+	 */
+	void reserve(size_t n)
+	{
+		Buffer* buf = buffer.load(std::memory_order_relaxed);
+		if (buf->capacity >= n)
+			return;
+
+		size_t capacity = buf->capacity;
+		while (capacity < n)
+			capacity *= 2;
+
+		// thieves may take items from the old buffer while they are copied, top only advances
+		long b = bottom.load(std::memory_order_relaxed);
+		long t = top.load(std::memory_order_acquire);
+		Buffer* grown = new Buffer(capacity, buf);
+		for (long i = t; i < b; ++i)
+			grown->put(i, buf->get(i));
+		buffer.store(grown, std::memory_order_release);
+	}
+
+	/**
+	 * Adds an item at the bottom of the queue
+	 * Must only be called by the owner of the queue
+	 * Assumes the queue has room for the item, see reserve()
+	 * @param item the item to add
+	 */
+	void push(T item)
+	{
+		long b = bottom.load(std::memory_order_relaxed);
+		Buffer* buf = buffer.load(std::memory_order_relaxed);
+		buf->put(b, item);
+		std::atomic_thread_fence(std::memory_order_release);
+		bottom.store(b + 1, std::memory_order_relaxed);
+	}
+
+	/**
+	 * Takes the item at the top of the queue
+	 * May be called by any kernel thread, including the owner
+	 * @param item set to the taken item
+	 * @return true if an item was taken, false if the queue is empty
+	 */
+	bool steal(T* item)
+	{
+		for (;;)
+		{
+			long t = top.load(std::memory_order_acquire);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			long b = bottom.load(std::memory_order_acquire);
+			if (t >= b)
+				return false;
+
+			T taken = buffer.load(std::memory_order_acquire)->get(t);
+			if (top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			{
+				*item = taken;
+				return true;
+			}
+			// lost the race to another thief, try again
+		}
+	}
+
+	/**
+	 * Returns true if the queue seems empty
+	 * The result may be stale when other kernel threads use the queue
+	 */
+	bool empty() const
+	{
+		return top.load(std::memory_order_relaxed) >= bottom.load(std::memory_order_relaxed);
+	}
+
+private:
+
+	/**
+	 * Circular buffer of items
+	 */
+	struct Buffer {
+
+		/**
+		 * The number of items the buffer holds, a power of 2
+		 */
+		size_t capacity;
+
+		/**
+		 * The items
+		 */
+		std::atomic<T>* items;
+
+		/**
+		 * The buffer this buffer replaced
+		 */
+		Buffer* retired;
+
+		/**
+		 * Buffer constructor
+		 * @param _capacity the number of items the buffer holds
+		 * @param _retired the buffer this buffer replaces
+		 */
+		Buffer(size_t _capacity, Buffer* _retired) :
+			capacity(_capacity), items(new std::atomic<T>[_capacity]), retired(_retired) {}
+
+		/**
+		 * Buffer destructor
+		 */
+		~Buffer() { delete[] items; }
+
+		/**
+		 * Returns the item at the given queue index
+		 */
+		T get(long index) const
+		{
+			return items[index & (capacity - 1)].load(std::memory_order_relaxed);
+		}
+
+		/**
+		 * Sets the item at the given queue index
+		 */
+		void put(long index, T item)
+		{
+			items[index & (capacity - 1)].store(item, std::memory_order_relaxed);
+		}
+	};
+
+	/**
+	 * Index of the top item, taken by steal
+	 */
+	std::atomic<long> top{0};
+
+	/**
+	 * Index after the bottom item, advanced by push
+	 */
+	std::atomic<long> bottom{0};
+
+	/**
+	 * The current buffer
+	 */
+	std::atomic<Buffer*> buffer;
+};
+
+#endif //UTHREADS_WORKQUEUE_H